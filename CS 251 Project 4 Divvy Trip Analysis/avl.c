@@ -16,61 +16,673 @@
 #include <string.h>
 #include <assert.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include "avl.h"
+#include "routes.h"
+#include "csv.h"
+#include "timer.h"
+#include "thread.h"
+#include "idtable.h"
+#include "triptable.h"
+#include "perf.h"
 
 
 //
-// AVLCreate:
+// AVLInit:
 //
-// Dynamically creates and returns an empty AVL tree.
+// Makes tree an empty AVL tree, whose values are valueSize bytes each.
+// The typed trees (see avltyped.h) call it on the AVL tree inside them,
+// with the size of their value type.
 //
-AVL *AVLCreate()
+void AVLInit(AVL *tree, int valueSize)
 {
-	AVL *tree;
-
-	tree = (AVL *)malloc(sizeof(AVL));
 	tree->Root = NULL;
 	tree->Count = 0;
+	tree->Chunks = NULL;
+	tree->Free = NULL;
+	tree->RetiredSize = 64;
+	tree->RetiredCount = 0;
+	tree->Retired = (AVLRetired*)malloc(sizeof(AVLRetired) * tree->RetiredSize);
+	tree->Versions = NULL;
+	tree->Shared = FALSE;
+	tree->ValueSize = valueSize;
+
+	// the value goes right after the node, padded so the next node in
+	// a chunk is aligned as well
+	tree->NodeSize = (int)sizeof(AVLNode) + (valueSize + 7) / 8 * 8;
+}
+
+
+//
+// Node arena: nodes are handed out one after another from chunks owned
+// by the tree, so a tree costs one malloc per chunk instead of one per
+// node, and nodes sit next to each other in insertion order, each one
+// NodeSize bytes: the node and its value.  Chunks
+// double in size up to AVL_CHUNK_MAX nodes.  Nodes are never freed one
+// at a time -- there is no delete -- only all together by AVLDestroy.
+//
+#define AVL_CHUNK_MIN	64
+#define AVL_CHUNK_MAX	65536
+
+//
+// adds a chunk with room for at least n nodes
+//
+static void _AVLAddChunk(AVL *tree, int n) {
+
+	int size = AVL_CHUNK_MIN;
+
+	// double the last chunk's size
+	if (tree->Chunks != NULL && tree->Chunks->Size * 2 <= AVL_CHUNK_MAX)
+		size = tree->Chunks->Size * 2;
+	else if (tree->Chunks != NULL)
+		size = AVL_CHUNK_MAX;
 
-	return tree;
+	if (size < n)
+		size = n;
+
+	AVLChunk *chunk = (AVLChunk*)malloc(sizeof(AVLChunk) + (size_t)tree->NodeSize * size);
+	chunk->Used = 0;
+	chunk->Size = size;
+	chunk->Next = tree->Chunks;		// newest chunk first
+	tree->Chunks = chunk;
 }
 
+//
+// returns node i of the chunk
+//
+static AVLNode *_AVLChunkNode(AVL *tree, AVLChunk *chunk, int i) {
+
+	return (AVLNode*)((char*)chunk->Nodes + (size_t)tree->NodeSize * i);
+}
 
 //
-// AVLFree:
+// makes sure the next n nodes come from one chunk
 //
-// Frees the memory associated with the tree: the handle and the nodes.
-// The provided function pointer is called to free the memory that
-// might have been allocated as part of the key or value.
+static void _AVLReserve(AVL *tree, int n) {
+
+	if (tree->Chunks == NULL || tree->Chunks->Size - tree->Chunks->Used < n)
+		_AVLAddChunk(tree, n);
+}
+
+//
+// returns a new, uninitialized node, a reclaimed one if there is one,
+// else from the arena
 //
-void _AVLFree(AVLNode *node, void(*fp)(AVLKey key, AVLValue value)) {
+static AVLNode *_AVLNewNode(AVL *tree) {
 
-	// base case
-	if (node == NULL)
+	AVLNode *node = tree->Free;
+
+	if (node != NULL) {
+		tree->Free = node->Left;
+		return node;
+	}
+
+	if (tree->Chunks == NULL || tree->Chunks->Used == tree->Chunks->Size)
+		_AVLAddChunk(tree, 1);
+
+	return _AVLChunkNode(tree, tree->Chunks, tree->Chunks->Used++);
+}
+
+
+//
+// Read path: any number of threads can search and traverse a tree
+// while one thread inserts into it, without locks, once the tree is
+// shared (see AVLShare).
+//
+// AVLInsert never changes a node a reader can reach.  It copies the
+// nodes on the search path, rebalances the copies, and then swaps in
+// the new root with one atomic store; a reader loads the root once and
+// walks a whole, unchanging version of the tree.  The replaced nodes
+// are retired, tagged with the current epoch, and the epoch goes up.
+// AVLUpdate, AVLMerge and AVLRebuild make new versions the same way.
+//
+// Copies are only needed if somebody can see the old nodes: a tree
+// that is not shared and has no version held (see AVLVersionTake) is
+// changed in place instead, with no copies and nothing retired.
+//
+// Readers announce themselves between AVLReadBegin and AVLReadEnd by
+// storing the epoch they started in, in a read state taken from a
+// shared pool for the read and given back after it; a retired node is
+// reused (see _AVLNewNode) only once every reader still reading
+// started after it was retired, so none of them can still hold it.
+// Without readers nodes are reused right away.  Node values must not
+// be changed in place while there are readers, and node pointers from
+// before an insert may point to a replaced copy after it.
+//
+// Only the stress test (see BenchStress) reads while another thread
+// inserts, so only its tree is shared.  The queries don't need
+// AVLReadBegin: batch workers are joined before an append runs, and
+// interactive mode has one thread.
+//
+// A version (see AVLVersionTake) is a reader that is not tied to a
+// thread or a read: it holds the epoch it was taken in, and the root
+// of then, until its last holder releases it.
+//
+#ifdef _MSC_VER
+#define AVL_THREAD_LOCAL __declspec(thread)
+#else
+#define AVL_THREAD_LOCAL __thread
+#endif
+
+// the read state of a thread, while it reads
+typedef struct AVLReader
+{
+	long long			Epoch;		// 0 => not reading
+	int					Depth;		// AVLReadBegin calls not ended yet
+	volatile long		InUse;		// 1 while a thread reads with it
+	struct AVLReader	*Next;		// all readers, of every thread
+} AVLReader;
+
+static AVL_THREAD_LOCAL AVLReader *_AVLThreadReader = NULL;
+static AVLReader *volatile _AVLReaders = NULL;		// list of all readers
+static volatile long long _AVLEpoch = 1;
+
+
+//
+// atomic loads and stores of the read path: readers load the root with
+// acquire, so the nodes it points to are complete; the other accesses
+// are sequentially consistent, so a reader's epoch is seen by the
+// writer before the reader loads the root
+//
+static AVLNode *_AVLLoadRoot(AVL *tree) {
+
+#if defined(_MSC_VER) && defined(_M_ARM64)
+	return (AVLNode*)__ldar64((unsigned __int64 volatile*)&tree->Root);
+#elif defined(_MSC_VER)
+	return *(AVLNode *volatile*)&tree->Root;		// acquire on x86 / x64
+#else
+	return __atomic_load_n(&tree->Root, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static void _AVLPublish(AVL *tree, AVLNode *root) {
+
+#ifdef _MSC_VER
+	InterlockedExchangePointer((PVOID volatile*)&tree->Root, root);
+#else
+	__atomic_store_n(&tree->Root, root, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static long long _AVLLoadEpoch(volatile long long *epoch) {
+
+#ifdef _MSC_VER
+	return InterlockedCompareExchange64(epoch, 0, 0);
+#else
+	return __atomic_load_n(epoch, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static void _AVLStoreEpoch(volatile long long *epoch, long long value) {
+
+#ifdef _MSC_VER
+	InterlockedExchange64(epoch, value);
+#else
+	__atomic_store_n(epoch, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static void _AVLNextEpoch() {
+
+#ifdef _MSC_VER
+	InterlockedIncrement64(&_AVLEpoch);
+#else
+	__atomic_add_fetch(&_AVLEpoch, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static AVLReader *_AVLFirstReader() {
+
+#ifdef _MSC_VER
+	return (AVLReader*)InterlockedCompareExchangePointer((PVOID volatile*)&_AVLReaders, NULL, NULL);
+#else
+	return __atomic_load_n(&_AVLReaders, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+//
+// takes the read state if no thread has it, returns non-zero if it did
+//
+static int _AVLClaimReader(AVLReader *reader) {
+
+#ifdef _MSC_VER
+	return InterlockedCompareExchange(&reader->InUse, 1, 0) == 0;
+#else
+	long expected = 0;
+
+	return __atomic_compare_exchange_n(&reader->InUse, &expected, 1, 0,
+		__ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+#endif
+}
+
+
+//
+// returns this thread's read state: the one it reads with already,
+// else a free one of the list, else a new one added to the list
+//
+static AVLReader *_AVLMyReader() {
+
+	AVLReader *reader = _AVLThreadReader;
+
+	if (reader != NULL)
+		return reader;
+
+	for (reader = _AVLFirstReader(); reader != NULL; reader = reader->Next) {
+		if (_AVLClaimReader(reader)) {
+			_AVLThreadReader = reader;
+			return reader;
+		}
+	}
+
+	reader = (AVLReader*)calloc(1, sizeof(AVLReader));
+	reader->InUse = 1;
+	_AVLThreadReader = reader;
+
+	// push it onto the list
+#ifdef _MSC_VER
+	AVLReader *head;
+
+	do {
+		head = _AVLReaders;
+		reader->Next = head;
+	} while (InterlockedCompareExchangePointer((PVOID volatile*)&_AVLReaders, reader, head) != head);
+#else
+	AVLReader *head = __atomic_load_n(&_AVLReaders, __ATOMIC_ACQUIRE);
+
+	do {
+		reader->Next = head;
+	} while (!__atomic_compare_exchange_n(&_AVLReaders, &head, reader, 1,
+		__ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+#endif
+
+	return reader;
+}
+
+
+//
+// AVLReadBegin:
+//
+// Starts reading trees on this thread: nodes reached from here until
+// AVLReadEnd stay valid even if another thread inserts meanwhile.
+// Calls can be nested.
+//
+void AVLReadBegin() {
+
+	AVLReader *reader = _AVLMyReader();
+
+	if (reader->Depth++ == 0)
+		_AVLStoreEpoch(&reader->Epoch, _AVLLoadEpoch(&_AVLEpoch));
+}
+
+
+//
+// AVLReadEnd:
+//
+// Ends reading, see AVLReadBegin; the outermost call gives the read
+// state back to the pool.
+//
+void AVLReadEnd() {
+
+	AVLReader *reader = _AVLThreadReader;
+
+	if (reader == NULL || --reader->Depth > 0)
 		return;
-	else {
-		// visit left
-		_AVLFree(node->Left, fp);
 
-		// visit right
-		_AVLFree(node->Right, fp);
+	_AVLStoreEpoch(&reader->Epoch, 0);
+	_AVLThreadReader = NULL;
+#ifdef _MSC_VER
+	InterlockedExchange(&reader->InUse, 0);
+#else
+	__atomic_store_n(&reader->InUse, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+
+//
+// AVLRoot:
+//
+// Returns the current root of the tree, to traverse while another
+// thread may insert -- between AVLReadBegin and AVLReadEnd.  Used by
+// the stress test only, see above.
+//
+AVLNode *AVLRoot(AVL *tree) {
+
+	return _AVLLoadRoot(tree);
+}
+
+
+//
+// AVLShare:
+//
+// Marks the tree as read by other threads while it changes: from now
+// on every change copies the nodes it changes, see above.  Call it
+// before the other threads start reading.
+//
+void AVLShare(AVL *tree) {
+
+	tree->Shared = TRUE;
+}
+
+
+static int _AVLLoadRefs(volatile int *refs) {
+
+#ifdef _MSC_VER
+	return InterlockedCompareExchange((volatile LONG*)refs, 0, 0);
+#else
+	return __atomic_load_n(refs, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static void _AVLStoreRefs(volatile int *refs, int value) {
+
+#ifdef _MSC_VER
+	InterlockedExchange((volatile LONG*)refs, value);
+#else
+	__atomic_store_n(refs, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static int _AVLSwapRefs(volatile int *refs, int expected, int value) {
+
+#ifdef _MSC_VER
+	return InterlockedCompareExchange((volatile LONG*)refs, value, expected) == expected;
+#else
+	return __atomic_compare_exchange_n(refs, &expected, value, 0, __ATOMIC_SEQ_CST,
+		__ATOMIC_SEQ_CST);
+#endif
+}
+
+static AVLVersion *_AVLFirstVersion(AVL *tree) {
+
+#ifdef _MSC_VER
+	return (AVLVersion*)InterlockedCompareExchangePointer((PVOID volatile*)&tree->Versions, NULL, NULL);
+#else
+	return __atomic_load_n(&tree->Versions, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+//
+// AVLVersionTake:
+//
+// Returns the current version of the tree, which stays as it is --
+// root and every node below it -- until AVLVersionRelease, while the
+// tree gets new versions.  Holders of the current version share it.
+// Can be called from any thread; there is no need for AVLReadBegin.
+//
+AVLVersion *AVLVersionTake(AVL *tree) {
+
+	AVLVersion *version;
+	int refs;
+
+	// share the current version if it is held already
+	for (version = _AVLFirstVersion(tree); version != NULL; version = version->Next) {
+		refs = _AVLLoadRefs(&version->Refs);
+		if (refs <= 0 || !_AVLSwapRefs(&version->Refs, refs, refs + 1))
+			continue;
+
+		// held now, so it can't change under us
+		if (version->Root == _AVLLoadRoot(tree))
+			return version;
+		AVLVersionRelease(version);
+	}
+
+	// else a free one, or a new one
+	for (version = _AVLFirstVersion(tree); version != NULL; version = version->Next) {
+		if (_AVLSwapRefs(&version->Refs, 0, -1))
+			break;
+	}
+
+	if (version == NULL) {
+		version = (AVLVersion*)malloc(sizeof(AVLVersion));
+		version->Epoch = 0;
+		version->Refs = -1;
+
+		// push it onto the list
+#ifdef _MSC_VER
+		AVLVersion *head;
+
+		do {
+			head = tree->Versions;
+			version->Next = head;
+		} while (InterlockedCompareExchangePointer((PVOID volatile*)&tree->Versions, version, head) != head);
+#else
+		AVLVersion *head = __atomic_load_n(&tree->Versions, __ATOMIC_ACQUIRE);
+
+		do {
+			version->Next = head;
+		} while (!__atomic_compare_exchange_n(&tree->Versions, &head, version, 1,
+			__ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+#endif
+	}
+
+	// the epoch first, as a reader does, then the root
+	_AVLStoreEpoch(&version->Epoch, _AVLLoadEpoch(&_AVLEpoch));
+	version->Root = _AVLLoadRoot(tree);
+	_AVLStoreRefs(&version->Refs, 1);
+
+	return version;
+}
+
+
+//
+// AVLVersionRelease:
+//
+// Lets go of a version from AVLVersionTake; once every holder has,
+// the nodes only it still used are reclaimed like retired ones.
+//
+void AVLVersionRelease(AVLVersion *version) {
+
+	int refs;
+
+	for (;;) {
+		refs = _AVLLoadRefs(&version->Refs);
+
+		if (refs > 1 && _AVLSwapRefs(&version->Refs, refs, refs - 1))
+			return;
+
+		// the last holder frees it, nobody can share it meanwhile
+		if (refs == 1 && _AVLSwapRefs(&version->Refs, 1, -1)) {
+			_AVLStoreEpoch(&version->Epoch, 0);
+			_AVLStoreRefs(&version->Refs, 0);
+			return;
+		}
+	}
+}
+
+
+//
+// AVLVersionHeld:
+//
+// Returns # of nodes kept only because of the version: retired since
+// it was taken, and before the next newer version held was.  Call it
+// on the thread that changes the tree, or while nobody does.
+//
+int AVLVersionHeld(AVL *tree, AVLVersion *version) {
+
+	long long from = _AVLLoadEpoch(&version->Epoch);
+	long long to = LLONG_MAX;
+	AVLVersion *other;
+	int i, held = 0;
+
+	if (from == 0)
+		return 0;
+
+	for (other = _AVLFirstVersion(tree); other != NULL; other = other->Next) {
+		long long epoch = _AVLLoadEpoch(&other->Epoch);
+		if (epoch > from && epoch < to)
+			to = epoch;
+	}
+
+	for (i = 0; i < tree->RetiredCount; i++) {
+		if (tree->Retired[i].Epoch >= from && tree->Retired[i].Epoch < to)
+			held++;
+	}
+
+	return held;
+}
+
+
+//
+// AVLVersionUsage:
+//
+// Returns # of versions held in *versions, and # of nodes kept for
+// them in *held.  Call it on the thread that changes the tree, or
+// while nobody does.
+//
+void AVLVersionUsage(AVL *tree, int *versions, int *held) {
+
+	long long oldest = LLONG_MAX;
+	AVLVersion *version;
+	int i;
+
+	*versions = 0;
+	*held = 0;
+
+	for (version = _AVLFirstVersion(tree); version != NULL; version = version->Next) {
+		long long epoch = _AVLLoadEpoch(&version->Epoch);
+		if (epoch == 0)
+			continue;
+
+		(*versions)++;
+		if (epoch < oldest)
+			oldest = epoch;
+	}
+
+	for (i = 0; i < tree->RetiredCount; i++) {
+		if (tree->Retired[i].Epoch >= oldest)
+			(*held)++;
+	}
+}
+
+
+//
+// TRUE if a change must copy the nodes it changes instead of changing
+// them in place: readers on other threads may see them, or a version
+// of the tree still holds them
+//
+static int _AVLMustCopy(AVL *tree) {
+
+	AVLVersion *version;
+
+	if (tree->Shared)
+		return TRUE;
+
+	for (version = _AVLFirstVersion(tree); version != NULL; version = version->Next) {
+		if (_AVLLoadEpoch(&version->Epoch) != 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static void _AVLReclaim(AVL *tree);
 
-		// delete node
-		fp(node->Key, node->Value);
-		free(node);
+//
+// remembers a node the new version of the tree no longer uses; when
+// the array is full the nodes no reader holds are reclaimed, and if
+// that frees less than half of it, it grows -- so reclaiming stays
+// amortized O(1) per node even while a long read holds many
+//
+static void _AVLRetire(AVL *tree, AVLNode *node, long long epoch) {
+
+	if (tree->RetiredCount == tree->RetiredSize) {
+		_AVLReclaim(tree);
+
+		if (tree->RetiredCount * 2 > tree->RetiredSize) {
+			tree->RetiredSize *= 2;
+			tree->Retired = (AVLRetired*)realloc(tree->Retired, sizeof(AVLRetired) * tree->RetiredSize);
+		}
+	}
+
+	tree->Retired[tree->RetiredCount].Node = node;
+	tree->Retired[tree->RetiredCount].Epoch = epoch;
+	tree->RetiredCount++;
+}
+
+
+//
+// moves the retired nodes no reader can hold anymore to the free list
+//
+static void _AVLReclaim(AVL *tree) {
+
+	long long oldest = _AVLLoadEpoch(&_AVLEpoch);
+	AVLReader *reader;
+	AVLVersion *version;
+	int i, kept = 0;
+
+	// the oldest epoch a reader is still in, or a version was taken in
+	for (reader = _AVLFirstReader(); reader != NULL; reader = reader->Next) {
+		long long epoch = _AVLLoadEpoch(&reader->Epoch);
+		if (epoch != 0 && epoch < oldest)
+			oldest = epoch;
+	}
+
+	for (version = _AVLFirstVersion(tree); version != NULL; version = version->Next) {
+		long long epoch = _AVLLoadEpoch(&version->Epoch);
+		if (epoch != 0 && epoch < oldest)
+			oldest = epoch;
+	}
+
+	for (i = 0; i < tree->RetiredCount; i++) {
+		AVLRetired retired = tree->Retired[i];
+
+		if (retired.Epoch < oldest) {
+			retired.Node->Left = tree->Free;
+			tree->Free = retired.Node;
+		}
+		else
+			tree->Retired[kept++] = retired;
 	}
 
-	return;
+	tree->RetiredCount = kept;
 }
 
 
-void AVLFree(AVL *tree, void(*fp)(AVLKey key, AVLValue value))
+//
+// AVLDestroy:
+//
+// Frees the memory associated with the tree: the nodes and versions,
+// not the tree itself, which is part of its typed tree.
+// The provided function pointer is called to free the memory that
+// might have been allocated as part of the key or value, once per key
+// of the current version: replaced copies and reclaimed nodes share
+// or no longer hold that memory.  Pass NULL if the values don't own
+// any memory, then only the chunks are freed.
+//
+void AVLDestroy(AVL *tree, void(*fp)(AVLKey key, void *value))
 {
-	// delete the nodes
-	_AVLFree(tree->Root, fp);
+	AVLChunk *chunk = tree->Chunks;
+	AVLIterator iter;
+	AVLNode *node;
+
+	// free the data inside each node of the tree
+	if (fp != NULL) {
+		AVLIteratorInit(&iter, tree->Root, AVLPreOrder);
+		while ((node = AVLIteratorNext(&iter)) != NULL)
+			fp(node->Key, AVL_NODE_VALUE(node));
+	}
 
-	// delete the handle
-	free(tree);
+	// delete the chunks
+	while (chunk != NULL) {
+		AVLChunk *next = chunk->Next;
+		free(chunk);
+		chunk = next;
+	}
+
+	// delete the versions
+	while (tree->Versions != NULL) {
+		AVLVersion *next = tree->Versions->Next;
+		free(tree->Versions);
+		tree->Versions = next;
+	}
+
+	free(tree->Retired);
 }
 
 
@@ -101,7 +713,9 @@ int AVLCompareKeys(AVLKey key1, AVLKey key2)
 //
 int AVLCount(AVL *tree)
 {
-	return tree->Count;
+	AVLNode *root = _AVLLoadRoot(tree);
+
+	return (root == NULL) ? 0 : root->Size;
 }
 
 
@@ -112,51 +726,160 @@ int AVLCount(AVL *tree)
 //
 int AVLHeight(AVL *tree)
 {
-	if (tree->Root == NULL)
+	AVLNode *root = _AVLLoadRoot(tree);
+
+	if (root == NULL)
 		return -1;
 	else
-		return tree->Root->Height;
+		return root->Height;
 }
 
 
 //
-// Rotate right the sub-tree rooted at node k2, return pointer
-// to root of newly-rotated sub-tree --- i.e. return pointer
-// to node k1 that was rotated up to top of sub-tree.  Heights
-// of the rotated sub-tree are also updated by this function.
+// pushes the sub-tree's nodes down to its first one in the order:
+// the left spine in-order; post-order, left when there is a left
+// child, else right, down to a leaf
 //
-int _height(AVLNode *cur)
+static void _AVLIteratorDescend(AVLIterator *iter, AVLNode *cur)
 {
-	if (cur == NULL)
-		return -1;
-	else
-		return cur->Height;
+	while (cur != NULL) {
+		iter->Stack[++iter->Top] = cur;
+		cur = (cur->Left != NULL || iter->Order == AVLInOrder) ? cur->Left : cur->Right;
+	}
 }
 
-int _max2(int x, int y)
+
+//
+// AVLIteratorInit:
+//
+// Starts a traversal of the sub-tree rooted at root in the given order.
+// The iterator keeps its own stack, so nothing is allocated and the
+// traversal can be abandoned at any point.  The next node is always on
+// top of the stack.
+//
+void AVLIteratorInit(AVLIterator *iter, AVLNode *root, AVLOrder order)
 {
-	return (x > y) ? x : y;
+	iter->Order = order;
+	iter->Top = -1;
+
+	if (order == AVLPreOrder) {
+		if (root != NULL)
+			iter->Stack[++iter->Top] = root;
+	}
+	else
+		_AVLIteratorDescend(iter, root);
 }
 
-AVLNode *RightRotate(AVLNode *k2)
+
+//
+// AVLIteratorNext:
+//
+// Returns the next node of the traversal, in any order, NULL when it
+// is done.
+//
+AVLNode *AVLIteratorNext(AVLIterator *iter)
 {
-	AVLNode *k1 = k2->Left;
+	AVLNode *node;
+	AVLNode *parent;
 
-	AVLNode *X = k1->Left;
-	AVLNode *Y = k1->Right;
-	AVLNode *Z = k2->Right;
+	if (iter->Order == AVLInOrder)
+		return AVLInOrderNext(iter);
 
-	//
-	// rotate k1 up, and k2 down to the right:
-	//
-	k1->Right = k2;
-	k2->Left = Y;
+	if (iter->Top < 0)
+		return NULL;
 
-	//
-	// recompute heights of nodes that moved:  k2, then k1
-	//
+	node = iter->Stack[iter->Top--];
+
+	if (iter->Order == AVLPreOrder) {
+		// its left sub-tree comes next, then its right
+		if (node->Right != NULL)
+			iter->Stack[++iter->Top] = node->Right;
+		if (node->Left != NULL)
+			iter->Stack[++iter->Top] = node->Left;
+	}
+	else if (iter->Top >= 0) {
+		// post-order: after a left child comes its parent's right
+		// sub-tree, if any, else the parent
+		parent = iter->Stack[iter->Top];
+		if (parent->Left == node)
+			_AVLIteratorDescend(iter, parent->Right);
+	}
+
+	return node;
+}
+
+
+//
+// AVLTraverse:
+//
+// Calls visit() for every node of the sub-tree rooted at root, in the
+// given order, until it returns FALSE.  Returns TRUE if every node was
+// visited, FALSE if the traversal was stopped early.
+//
+int AVLTraverse(AVLNode *root, AVLOrder order, int(*visit)(AVLNode *node, void *arg), void *arg)
+{
+	AVLIterator iter;
+	AVLNode *node;
+
+	AVLIteratorInit(&iter, root, order);
+
+	while ((node = AVLIteratorNext(&iter)) != NULL) {
+		if (!visit(node, arg))
+			return FALSE;		// stopped
+	}
+
+	return TRUE;
+}
+
+
+//
+// Rotate right the sub-tree rooted at node k2, return pointer
+// to root of newly-rotated sub-tree --- i.e. return pointer
+// to node k1 that was rotated up to top of sub-tree.  Heights
+// and sizes of the rotated sub-tree are also updated by this function.
+//
+int _height(AVLNode *cur)
+{
+	if (cur == NULL)
+		return -1;
+	else
+		return cur->Height;
+}
+
+int _max2(int x, int y)
+{
+	return (x > y) ? x : y;
+}
+
+int _size(AVLNode *cur)
+{
+	if (cur == NULL)
+		return 0;
+	else
+		return cur->Size;
+}
+
+AVLNode *RightRotate(AVLNode *k2)
+{
+	AVLNode *k1 = k2->Left;
+
+	AVLNode *X = k1->Left;
+	AVLNode *Y = k1->Right;
+	AVLNode *Z = k2->Right;
+
+	//
+	// rotate k1 up, and k2 down to the right:
+	//
+	k1->Right = k2;
+	k2->Left = Y;
+
+	//
+	// recompute heights and sizes of nodes that moved:  k2, then k1
+	//
 	k2->Height = 1 + _max2(_height(k2->Left), _height(k2->Right));
 	k1->Height = 1 + _max2(_height(k1->Left), _height(k1->Right));
+	k2->Size = 1 + _size(k2->Left) + _size(k2->Right);
+	k1->Size = 1 + _size(k1->Left) + _size(k1->Right);
 
 	return k1;  // k1 is the new root of rotated sub-tree:
 }
@@ -165,7 +888,7 @@ AVLNode *RightRotate(AVLNode *k2)
 // Rotate left the sub-tree rooted at node k1, return pointer
 // to root of newly-rotated sub-tree --- i.e. return pointer
 // to node k2 that was rotated up to top of sub-tree.  Heights
-// of the rotated sub-tree are also updated by this function.
+// and sizes of the rotated sub-tree are also updated by this function.
 //
 AVLNode *LeftRotate(AVLNode *k1)
 {
@@ -182,34 +905,42 @@ AVLNode *LeftRotate(AVLNode *k1)
 	k1->Right = Y;
 
 	//
-	// recompute heights of nodes that moved:  k1, then k2
+	// recompute heights and sizes of nodes that moved:  k1, then k2
 	//
 	k1->Height = 1 + _max2(_height(k1->Left), _height(k1->Right));
 	k2->Height = 1 + _max2(_height(k2->Left), _height(k2->Right));
+	k1->Size = 1 + _size(k1->Left) + _size(k1->Right);
+	k2->Size = 1 + _size(k2->Left) + _size(k2->Right);
 
 	return k2;  // k2 is the new root of rotated sub-tree:
 }
 
 
 //
-// AVL Insert:
-//
-// Inserts the given (key, value) into the AVL tree, rebalancing
-// the tree as necessary.  Returns true (non-zero) if successful,
-// false (0) if not --- insert fails if the key is already in the
-// tree (no changes are made to the tree in this case).
+// Inserts (key, value) into the version of the tree rooted at root,
+// rebalancing as necessary, and returns the root of the new version;
+// NULL if the key is already there.  If copy, the nodes on the search
+// path are copied, the originals go into path[0, *pathLength), and
+// nothing of root's version is changed; else the path is changed in
+// place and *pathLength is 0.
 //
 #define _TRUE  1
 #define _FALSE 0
 
-int AVLInsert(AVL *tree, AVLKey key, AVLValue value)
+static AVLNode *_AVLCopyInsert(AVL *tree, AVLNode *root, AVLKey key, const void *value,
+	AVLNode **path, int *pathLength, int copy)
 {
 	AVLNode *prev = NULL;
-	AVLNode *cur = tree->Root;
+	AVLNode *cur = root;
 
 	AVLNode *stack[64];
 	int      top = -1;
 
+	AVLNode *newNode;
+	AVLNode *N;
+	int      rebalance = _FALSE;  // false by default, e.g. if tree is empty:
+	int      i;
+
 	//
 	// first we search the tree to see if it already contains key:
 	//
@@ -218,444 +949,1701 @@ int AVLInsert(AVL *tree, AVLKey key, AVLValue value)
 		top++;
 		stack[top] = cur;
 
-		if (AVLCompareKeys(key, cur->Key) == 0)  // already in tree, failed:
-			return _FALSE;
-		else if (AVLCompareKeys(key, cur->Key) < 0)  // smaller, go left:
-		{
-			prev = cur;
-			cur = cur->Left;
-		}
-		else  // larger, go right:
-		{
-			prev = cur;
-			cur = cur->Right;
+		if (AVLCompareKeys(key, cur->Key) == 0)  // already in tree, failed:
+			return NULL;
+		else if (AVLCompareKeys(key, cur->Key) < 0)  // smaller, go left:
+		{
+			prev = cur;
+			cur = cur->Left;
+		}
+		else  // larger, go right:
+		{
+			prev = cur;
+			cur = cur->Right;
+		}
+	}
+
+	//
+	// Readers may be on the path, so work on copies of its nodes from
+	// here on -- the stack holds the copies, each linked to the next
+	// one -- and leave the originals to the caller:
+	//
+	*pathLength = copy ? top + 1 : 0;
+	for (i = 0; i < *pathLength; i++) {
+		path[i] = stack[i];
+		stack[i] = _AVLNewNode(tree);
+		memcpy(stack[i], path[i], tree->NodeSize);
+
+		if (i > 0 && stack[i - 1]->Left == path[i])
+			stack[i - 1]->Left = stack[i];
+		else if (i > 0)
+			stack[i - 1]->Right = stack[i];
+	}
+
+	prev = (top >= 0) ? stack[top] : NULL;
+	root = (top >= 0) ? stack[0] : NULL;
+
+	// 
+	// If we get here, tree does not contain key, so insert new node
+	// where we fell out of tree:
+	//
+	newNode = _AVLNewNode(tree);
+	newNode->Key = key;
+	memcpy(AVL_NODE_VALUE(newNode), value, tree->ValueSize);
+	newNode->Left = NULL;
+	newNode->Right = NULL;
+	newNode->Height = 0;
+	newNode->Size = 1;
+
+	//
+	// link T where we fell out of tree -- after prev:
+	//
+	if (prev == NULL)  // tree is empty, insert @ root:
+	{
+		root = newNode;
+	}
+	else if (AVLCompareKeys(key, prev->Key) < 0)  // smaller, insert to left:
+	{
+		prev->Left = newNode;
+	}
+	else  // larger, insert to right:
+	{
+		prev->Right = newNode;
+	}
+
+	PERF_COUNT(PerfInserts, 1);
+
+	// every node on the path gained one node below it
+	for (i = 0; i <= top; i++)
+		stack[i]->Size++;
+
+	//
+	// Now walk back up the tree, updating heights and looking for
+	// where the AVL balancing criteria may be broken.  If we reach
+	// a node where the height doesn't change, then we're done -- the
+	// tree is still balanced.  If we reach a node where the AVL 
+	// condition is broken, we fix locally and we're done.  One or two
+	// local rotations is enough to re-balance the tree.
+	//
+	while (top >= 0)  // stack != empty::
+	{
+		N = stack[top];  // N = pop();
+		top--;
+
+		int hl = _height(N->Left);
+		int hr = _height(N->Right);
+		int newH = 1 + _max2(hl, hr);
+
+		if (newH == N->Height)  // heights the same, still an AVL tree::
+		{
+			rebalance = _FALSE;
+			break;
+		}
+		else if (abs(hl - hr) > 1)  // AVL condition broken, we have to fix::
+		{
+			rebalance = _TRUE;
+			break;
+		}
+		else  // update height and continue walking up tree::
+		{
+			N->Height = newH;
+		}
+	}
+
+	//
+	// Okay, does the tree need to be rebalanced?
+	//
+	if (rebalance)
+	{
+		cur = N;
+
+		//
+		// if we get here, then the AVL condition is broken at "cur".  So we
+		// have to decide which of the 4 cases it is and then rotate to fix.
+		//
+
+		// we need cur's parent, so pop the stack one more time
+		if (top < 0)     // stack is empty, ==> N is root
+			prev = NULL;   // flag this with prev == NULL
+		else  // stack not empty, so obtain ptr to cur's parent:
+			prev = stack[top];
+
+		//
+		// which of the 4 cases?
+		//
+		if (AVLCompareKeys(newNode->Key, cur->Key) < 0)  // case 1 or 2:
+		{
+			// case 1 or case 2?  either way, we know cur->left exists:
+			AVLNode *L = cur->Left;
+
+			if (AVLCompareKeys(newNode->Key, L->Key) > 0)
+			{
+				// case 2: left rotate @L followed by a right rotate @cur:
+				cur->Left = LeftRotate(L);
+				PERF_COUNT(PerfDoubleRotations, 1);
+			}
+			else
+				PERF_COUNT(PerfSingleRotations, 1);
+
+			// case 1 or 2:  right rotate @cur
+			if (prev == NULL)
+				root = RightRotate(cur);
+			else if (prev->Left == cur)
+				prev->Left = RightRotate(cur);
+			else
+				prev->Right = RightRotate(cur);
+		}
+		else
+		{
+			//
+			// case 3 or case 4?  either way, we know cur->right exists:
+			//
+			AVLNode *R = cur->Right;
+
+			if (AVLCompareKeys(newNode->Key, R->Key) < 0)
+			{
+				// case 3: right rotate @R followed by a left rotate @cur:
+				cur->Right = RightRotate(R);
+				PERF_COUNT(PerfDoubleRotations, 1);
+			}
+			else
+				PERF_COUNT(PerfSingleRotations, 1);
+
+			// case 3 or case 4:  left rotate @cur:
+			if (prev == NULL)
+				root = LeftRotate(cur);
+			else if (prev->Left == cur)
+				prev->Left = LeftRotate(cur);
+			else
+				prev->Right = LeftRotate(cur);
+		}
+	}
+
+//	free(newNode);
+	return root;  // success:
+}
+
+
+//
+// swaps in the new version of the tree, then retires the nodes of the
+// old one it no longer uses
+//
+static void _AVLSwapVersion(AVL *tree, AVLNode *root, AVLNode **replaced, int count) {
+
+	int i;
+
+	_AVLPublish(tree, root);
+
+	long long epoch = _AVLLoadEpoch(&_AVLEpoch);
+	for (i = 0; i < count; i++)
+		_AVLRetire(tree, replaced[i], epoch);
+	_AVLNextEpoch();
+}
+
+
+//
+// AVL Insert:
+//
+// Inserts the given (key, value) into the AVL tree, rebalancing
+// the tree as necessary.  Returns true (non-zero) if successful,
+// false (0) if not --- insert fails if the key is already in the
+// tree (no changes are made to the tree in this case).  The value,
+// ValueSize bytes at value, is copied into the node.  Readers on
+// other threads see the tree before or after the insert, never in
+// between, see the read path above; with no readers and no versions
+// the path is changed in place.
+//
+int AVLInsert(AVL *tree, AVLKey key, const void *value)
+{
+	AVLNode *path[64];		// the nodes the search went through
+	int      pathLength;
+	int      copy = _AVLMustCopy(tree);
+
+	AVLNode *root = _AVLCopyInsert(tree, tree->Root, key, value, path, &pathLength, copy);
+
+	if (root == NULL)
+		return _FALSE;
+
+	tree->Count++;
+	if (copy)
+		_AVLSwapVersion(tree, root, path, pathLength);
+	else
+		_AVLPublish(tree, root);		// a rotation may have moved it
+
+	return _TRUE;
+}
+
+
+//
+// AVLPersistentInsert:
+//
+// Inserts (key, value) into the version of the tree rooted at root
+// and returns the root of the new version, NULL if the key is already
+// there.  The new version shares all but the O(log N) nodes on the
+// search path with the old one, which stays as it was; neither is
+// published, so the tree and its readers don't see the insert.  The
+// path's nodes of the old version are added to replaced[*count, ...),
+// at most AVL_MAX_HEIGHT + 1 of them, for the caller to retire once
+// nobody needs the old version, see AVLMerge.  The nodes come from the
+// tree's arena and go with AVLDestroy.
+//
+AVLNode *AVLPersistentInsert(AVL *tree, AVLNode *root, AVLKey key, const void *value,
+	AVLNode **replaced, int *count)
+{
+	int pathLength = 0;
+
+	root = _AVLCopyInsert(tree, root, key, value, &replaced[*count], &pathLength, _TRUE);
+	if (root != NULL)
+		*count += pathLength;
+
+	return root;
+}
+
+//
+// AVLSearch: searches the binary search tree for a node containing the
+// same key.  If a match is found, a pointer to the node is returned, 
+// otherwise NULL is returned.
+//
+AVLNode *AVLSearch(AVL *tree, AVLKey key)
+{	
+	// cur as tree->Root
+	AVLNode *cur = _AVLLoadRoot(tree);
+	int depth = 0;			// nodes visited, for perf
+
+	PERF_COUNT(PerfSearches, 1);
+
+	while (cur != NULL) {
+		depth++;
+		if (key == cur->Key) {		// found, return cur
+			PERF_COUNT(PerfSearchDepth, depth);
+			return cur;		
+		}
+		else if (key < cur->Key) {	// go left
+			cur = cur->Left;
+		}
+		else {						// go right
+			cur = cur->Right;
+		}
+	}
+
+	PERF_COUNT(PerfSearchDepth, depth);
+	return NULL;			// not found
+}
+
+
+
+//
+// merges sorted runs a[lo, mid) and a[mid, hi) into out[lo, hi), taking
+// from the left run on equal keys so the sort is stable
+//
+static void _AVLMergeRuns(AVLPair *a, int lo, int mid, int hi, AVLPair *out) {
+
+	int i = lo, j = mid, k = lo;
+
+	while (i < mid && j < hi) {
+		if (a[j].Key < a[i].Key)
+			out[k++] = a[j++];
+		else
+			out[k++] = a[i++];
+	}
+
+	while (i < mid)
+		out[k++] = a[i++];
+	while (j < hi)
+		out[k++] = a[j++];
+}
+
+
+//
+// AVLSortPairs:
+//
+// Stable natural merge sort of the pairs by key: ascending runs are
+// kept, strictly descending runs are reversed, then neighbouring runs
+// are merged until one is left -- so nearly sorted input, ascending or
+// descending, costs close to O(N).  Afterwards only the first
+// occurrence of each key is kept in pairs[0, unique), the other
+// duplicates are moved after it, in pairs[unique, count).  Returns
+// unique.
+//
+int AVLSortPairs(AVLPair *pairs, int count) {
+
+	AVLPair *temp;
+	AVLPair *from, *to, *swap;
+	int *runs;				// start of each run, runs[nRuns] == count
+	int nRuns = 0;
+	int i, j, unique, dups;
+
+	if (count <= 1)
+		return count;
+
+	temp = (AVLPair*)malloc(sizeof(AVLPair) * count);
+	runs = (int*)malloc(sizeof(int) * (count + 1));
+
+	//
+	// find the runs:
+	//
+	i = 0;
+	while (i < count) {
+		runs[nRuns++] = i;
+		j = i + 1;
+
+		if (j < count && pairs[j].Key < pairs[i].Key) {
+			// strictly descending run, reverse it
+			while (j < count && pairs[j].Key < pairs[j - 1].Key)
+				j++;
+
+			int lo = i, hi = j - 1;
+			while (lo < hi) {
+				AVLPair t = pairs[lo];
+				pairs[lo] = pairs[hi];
+				pairs[hi] = t;
+				lo++;
+				hi--;
+			}
+		}
+		else {
+			// ascending run
+			while (j < count && pairs[j].Key >= pairs[j - 1].Key)
+				j++;
+		}
+
+		i = j;
+	}
+	runs[nRuns] = count;
+
+	//
+	// merge neighbouring runs until there is only one:
+	//
+	from = pairs;
+	to = temp;
+	while (nRuns > 1) {
+		int merged = 0;
+
+		for (i = 0; i < nRuns; i += 2) {
+			if (i + 1 < nRuns)
+				_AVLMergeRuns(from, runs[i], runs[i + 1], runs[i + 2], to);
+			else	// odd one out, just copy
+				memcpy(&to[runs[i]], &from[runs[i]], sizeof(AVLPair) * (runs[i + 1] - runs[i]));
+			runs[merged++] = runs[i];
+		}
+		runs[merged] = count;
+		nRuns = merged;
+
+		swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != pairs)
+		memcpy(pairs, from, sizeof(AVLPair) * count);
+
+	//
+	// keep the first of each key up front, duplicates go to the end:
+	//
+	unique = 1;
+	dups = 0;
+	for (i = 1; i < count; i++) {
+		if (pairs[i].Key == pairs[unique - 1].Key)
+			temp[dups++] = pairs[i];
+		else
+			pairs[unique++] = pairs[i];
+	}
+	memcpy(&pairs[unique], temp, sizeof(AVLPair) * dups);
+
+	free(temp);
+	free(runs);
+
+	return unique;
+}
+
+
+//
+// AVLRank:
+//
+// Returns # of keys in the tree smaller than key, in O(log N) using
+// the sub-tree sizes.
+//
+int AVLRank(AVL *tree, AVLKey key)
+{
+	AVLNode *cur = _AVLLoadRoot(tree);
+	int rank = 0;
+
+	while (cur != NULL) {
+		if (AVLCompareKeys(key, cur->Key) <= 0)
+			cur = cur->Left;
+		else {
+			// cur and its left sub-tree are all smaller
+			rank += _size(cur->Left) + 1;
+			cur = cur->Right;
+		}
+	}
+
+	return rank;
+}
+
+
+//
+// AVLSelect:
+//
+// Returns the node with the k-th smallest key, k = 0 being the
+// smallest, or NULL if k is out of range.  O(log N).
+//
+AVLNode *AVLSelect(AVL *tree, int k)
+{
+	AVLNode *cur = _AVLLoadRoot(tree);
+
+	while (cur != NULL) {
+		int leftSize = _size(cur->Left);
+
+		if (k < leftSize)
+			cur = cur->Left;
+		else if (k == leftSize)
+			return cur;		// found
+		else {
+			k -= leftSize + 1;
+			cur = cur->Right;
+		}
+	}
+
+	return NULL;		// out of range
+}
+
+
+//
+// recursively builds a perfectly balanced tree from pairs[lo, hi),
+// returns the root
+//
+static AVLNode *_AVLBuildFromSorted(AVL *tree, AVLPair *pairs, int lo, int hi) {
+
+	// base case
+	if (lo >= hi)
+		return NULL;
+
+	int mid = lo + (hi - lo) / 2;
+	AVLNode *node = _AVLNewNode(tree);
+
+	node->Key = pairs[mid].Key;
+	memcpy(AVL_NODE_VALUE(node), pairs[mid].Value, tree->ValueSize);
+	node->Left = _AVLBuildFromSorted(tree, pairs, lo, mid);
+	node->Right = _AVLBuildFromSorted(tree, pairs, mid + 1, hi);
+	node->Height = 1 + _max2(_height(node->Left), _height(node->Right));
+	node->Size = hi - lo;
+
+	return node;
+}
+
+
+//
+// AVLBuildFromSorted:
+//
+// Builds a height-optimal tree from pairs sorted by key with no
+// duplicates, in O(N).  The tree must be empty; if it's not, the pairs
+// are inserted one by one instead.  Returns # of pairs inserted.
+//
+int AVLBuildFromSorted(AVL *tree, AVLPair *pairs, int count) {
+
+	int i, inserted = 0;
+
+	if (tree->Root != NULL) {
+		for (i = 0; i < count; i++)
+			inserted += AVLInsert(tree, pairs[i].Key, pairs[i].Value);
+		return inserted;
+	}
+
+	_AVLReserve(tree, count);		// all the nodes in one chunk
+	tree->Count = count;
+	_AVLPublish(tree, _AVLBuildFromSorted(tree, pairs, 0, count));
+
+	return count;
+}
+
+
+//
+// AVLBulkLoad:
+//
+// Sorts the pairs (see AVLSortPairs) and builds the tree from them,
+// the first pair wins if a key appears more than once.  Returns # of
+// pairs inserted; the duplicates left out are in pairs[inserted, count).
+//
+int AVLBulkLoad(AVL *tree, AVLPair *pairs, int count) {
+
+	int unique = AVLSortPairs(pairs, count);
+
+	return AVLBuildFromSorted(tree, pairs, unique);
+}
+
+
+//
+// first of pairs[lo, hi) with a key >= key
+//
+static int _AVLLowerBound(AVLPair *pairs, int lo, int hi, AVLKey key) {
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (pairs[mid].Key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+//
+// copies the sub-tree rooted at node along the paths to the keys of
+// pairs[lo, hi), giving the ones found their new values; the nodes
+// copied go into replaced.  Returns the root of the new sub-tree.  If
+// replaced is NULL, the values are changed in place, nothing is
+// copied, and node is returned.
+//
+static AVLNode *_AVLCopyUpdate(AVL *tree, AVLNode *node, AVLPair *pairs, int lo, int hi,
+	AVLNode **replaced, int *count, int *updated) {
+
+	// no keys below here, share the sub-tree
+	if (node == NULL || lo >= hi)
+		return node;
+
+	int mid = _AVLLowerBound(pairs, lo, hi, node->Key);
+	int end = (mid < hi && pairs[mid].Key == node->Key) ? mid + 1 : mid;
+
+	AVLNode *copy = node;
+	if (replaced != NULL) {
+		copy = _AVLNewNode(tree);
+		memcpy(copy, node, tree->NodeSize);
+		replaced[(*count)++] = node;
+	}
+
+	if (end > mid) {
+		memcpy(AVL_NODE_VALUE(copy), pairs[mid].Value, tree->ValueSize);
+		(*updated)++;
+	}
+
+	copy->Left = _AVLCopyUpdate(tree, node->Left, pairs, lo, mid, replaced, count, updated);
+	copy->Right = _AVLCopyUpdate(tree, node->Right, pairs, end, hi, replaced, count, updated);
+
+	return copy;
+}
+
+
+//
+// AVLUpdate:
+//
+// Gives the keys of pairs, sorted by key with no duplicates, their
+// new values in a new version of the tree, which copies only the
+// nodes on the paths to them -- O(k log(N/k)) for k keys -- and shares
+// the rest.  Keys not in the tree are left out.  Readers see every
+// update or none, and versions taken before keep the old values; with
+// no readers and no versions the values are changed in place.
+// Returns # of keys updated.
+//
+int AVLUpdate(AVL *tree, AVLPair *pairs, int count) {
+
+	int replacedCount = 0, updated = 0;
+
+	if (tree->Root == NULL || count == 0)
+		return 0;
+
+	if (!_AVLMustCopy(tree)) {
+		_AVLCopyUpdate(tree, tree->Root, pairs, 0, count, NULL, &replacedCount, &updated);
+		return updated;
+	}
+
+	// at most every node, and at most one path per key
+	long long most = (long long)count * (tree->Root->Height + 1);
+	if (most > tree->Root->Size)
+		most = tree->Root->Size;
+
+	AVLNode **replaced = (AVLNode**)malloc(sizeof(AVLNode*) * (size_t)most);
+	AVLNode *root = _AVLCopyUpdate(tree, tree->Root, pairs, 0, count, replaced,
+		&replacedCount, &updated);
+
+	_AVLSwapVersion(tree, root, replaced, replacedCount);
+	free(replaced);
+
+	return updated;
+}
+
+
+//
+// AVLMerge:
+//
+// Gives the keys of pairs, sorted by key with no duplicates, their
+// new values, and inserts the ones not in the tree, in one new
+// version: a chain of persistent inserts for the new keys (see
+// AVLPersistentInsert), then the update of the others (see AVLUpdate)
+// on the result, which is published once.  Copies only the O(log N)
+// nodes on the path to each key and shares the rest.  Readers see all
+// of it or none, and versions taken before keep the old tree; with no
+// readers and no versions the tree is changed in place.
+// Returns # of keys inserted.
+//
+int AVLMerge(AVL *tree, AVLPair *pairs, int count) {
+
+	AVLNode *root = tree->Root;
+	AVLNode *next;
+	AVLNode **replaced;
+	AVLNode *path[AVL_MAX_HEIGHT + 1];
+	AVLPair *existing;
+	int existingCount = 0;
+	int size = 2 * (AVL_MAX_HEIGHT + 1);
+	int replacedCount = 0, inserted = 0, updated = 0;
+	int pathLength;
+	int i;
+
+	if (count == 0)
+		return 0;
+
+	// in place: insert or update each key, publish once
+	if (!_AVLMustCopy(tree)) {
+		for (i = 0; i < count; i++) {
+			next = _AVLCopyInsert(tree, root, pairs[i].Key, pairs[i].Value, path, &pathLength,
+				_FALSE);
+			if (next != NULL) {
+				root = next;
+				inserted++;
+			}
+			else
+				_AVLCopyUpdate(tree, root, pairs, i, i + 1, NULL, &replacedCount, &updated);
+		}
+
+		tree->Count += inserted;
+		_AVLPublish(tree, root);
+		return inserted;
+	}
+
+	replaced = (AVLNode**)malloc(sizeof(AVLNode*) * size);
+	existing = (AVLPair*)malloc(sizeof(AVLPair) * count);
+
+	// insert the new keys, one version after another
+	for (i = 0; i < count; i++) {
+		if (replacedCount + AVL_MAX_HEIGHT + 1 > size) {
+			size *= 2;
+			replaced = (AVLNode**)realloc(replaced, sizeof(AVLNode*) * size);
+		}
+
+		next = AVLPersistentInsert(tree, root, pairs[i].Key, pairs[i].Value, replaced,
+			&replacedCount);
+		if (next != NULL) {
+			root = next;
+			inserted++;
+		}
+		else
+			existing[existingCount++] = pairs[i];		// already there
+	}
+
+	// update the others: at most every node, and at most one path per key
+	if (existingCount > 0) {
+		long long most = (long long)existingCount * (root->Height + 1);
+		if (most > root->Size)
+			most = root->Size;
+
+		if (replacedCount + most > size) {
+			size = replacedCount + (int)most;
+			replaced = (AVLNode**)realloc(replaced, sizeof(AVLNode*) * size);
+		}
+
+		root = _AVLCopyUpdate(tree, root, existing, 0, existingCount, replaced, &replacedCount,
+			&updated);
+	}
+
+	// the copies made by the chain are retired with the rest, no
+	// reader ever saw them
+	tree->Count += inserted;
+	_AVLSwapVersion(tree, root, replaced, replacedCount);
+
+	free(replaced);
+	free(existing);
+	return inserted;
+}
+
+
+//
+// AVLRebuild:
+//
+// Replaces the contents of the tree with pairs, sorted by key with no
+// duplicates: the new version is built height-optimal in O(N), as by
+// AVLBuildFromSorted, swapped in, and every node of the old one is
+// retired -- or, with no readers and no versions, goes straight to the
+// free list.  For when most values change, so a copy of the whole tree
+// costs no more than updating it would.
+//
+void AVLRebuild(AVL *tree, AVLPair *pairs, int count) {
+
+	AVLIterator iter;
+	AVLNode *node;
+	AVLNode *old = tree->Root;
+	int copy = _AVLMustCopy(tree);
+
+	tree->Count = count;
+	_AVLPublish(tree, _AVLBuildFromSorted(tree, pairs, 0, count));
+
+	// the old version is whole until its nodes are reclaimed; the
+	// iterator is past a node's children once it returns the node, so
+	// its Left can link the free list
+	long long epoch = _AVLLoadEpoch(&_AVLEpoch);
+	AVLIteratorInit(&iter, old, AVLPreOrder);
+	while ((node = AVLIteratorNext(&iter)) != NULL) {
+		if (copy)
+			_AVLRetire(tree, node, epoch);
+		else {
+			node->Left = tree->Free;
+			tree->Free = node;
+		}
+	}
+	if (copy)
+		_AVLNextEpoch();
+}
+
+
+
+//
+// Builds the tree with stations.  Station names are stored one after
+// another in a single buffer, which is returned; the caller frees it
+// once the tree is gone.
+// 
+char *AVLBuildStationsTree(StationTree *tree, char *StationsFileName) {
+
+	MappedFile file;
+	CSVReader reader;
+	CSVField fields[6];
+	AVLPair *pairs;			// the stations, to be bulk loaded
+	STATION *values;		// and their values
+	int size = 1024;
+	int i;
+	char *names;			// all the names
+	size_t namesUsed = 0;
+	int rows = 0;
+	double start = TimerNow();
+
+	// map the file
+	if (!MapFile(&file, StationsFileName)) {
+		printf("**Error: unable to open '%s'\n\n", StationsFileName);
+		exit(-1);
+	}
+
+	// names can't take more room than the file itself
+	names = (char*)malloc(file.Size + 1);
+	pairs = (AVLPair*)malloc(sizeof(AVLPair) * size);
+	values = (STATION*)malloc(sizeof(STATION) * size);
+
+	CSVInit(&reader, file.Data, file.Size);
+	CSVNextRow(&reader, fields, 6);		// skip the header line
+
+	while (CSVNextRow(&reader, fields, 6) >= 5) {
+		// grow the arrays if needed
+		if (rows == size) {
+			size *= 2;
+			pairs = (AVLPair*)realloc(pairs, sizeof(AVLPair) * size);
+			values = (STATION*)realloc(values, sizeof(STATION) * size);
+		}
+
+		STATION *value = &values[rows];
+		pairs[rows].Key = CSVParseInt(&fields[0]);
+
+		// copy the name into the buffer
+		value->Name = names + namesUsed;
+		namesUsed += CSVCopyField(&fields[1], value->Name) + 1;
+
+		value->Coordinates.latitude = CSVParseDouble(&fields[2]);
+		value->Coordinates.longtitude = CSVParseDouble(&fields[3]);
+		value->Capacity = CSVParseInt(&fields[4]);
+
+		// initialize tripCount to 0
+		value->TripCount = 0;
+
+		rows++;
+	}
+
+	// the values don't move anymore, point the pairs to them
+	for (i = 0; i < rows; i++)
+		pairs[i].Value = &values[i];
+
+	// build the tree, first row wins for a duplicate id
+	AVLBulkLoad(&tree->Base, pairs, rows);
+	free(pairs);
+	free(values);
+
+	CSVReportThroughput(StationsFileName, file.Size, rows, TimerNow() - start);
+	UnmapFile(&file);		// release the file
+
+	PERF_STOP(PerfLoadStations, start);
+	return names;
+}
+
+
+//
+// part of the trips file parsed by one thread: the trips in file order,
+// the rows as (trip id, trip) pairs, plus the bike and station trip
+// counts of those rows
+//
+typedef struct TripChunk
+{
+	const char	*Start;
+	const char	*End;
+	TRIP		*Trips;
+	AVLPair		*Rows;			// Value points to a trip of Trips
+	int			Count;
+	int			Size;
+	int			Unique;			// rows with distinct ids, see _AVLLoadTripChunk
+	IDCounts	*Bikes;			// partial trip counts per bike, NULL => not counted
+	IDCounts	*Stations;		// partial trip counts per station, NULL => not counted
+
+} TripChunk;
+
+
+//
+// thread function: parses the rows of one chunk and counts trips
+// per bike and per station, if there are counts
+//
+static void _AVLParseTripChunk(void *arg) {
+
+	TripChunk *chunk = (TripChunk*)arg;
+	CSVReader reader;
+	CSVField fields[8];
+	TRIP *trip;
+	int i;
+
+	CSVInit(&reader, chunk->Start, chunk->End - chunk->Start);
+
+	// trip_id, starttime, stoptime, bikeid, tripduration,
+	// from_station_id, from_station_name, to_station_id, ...
+	while (CSVNextRow(&reader, fields, 8) >= 8) {
+		// grow the arrays if needed
+		if (chunk->Count == chunk->Size) {
+			chunk->Size *= 2;
+			chunk->Trips = (TRIP*)realloc(chunk->Trips, sizeof(TRIP) * chunk->Size);
+			chunk->Rows = (AVLPair*)realloc(chunk->Rows, sizeof(AVLPair) * chunk->Size);
+		}
+
+		trip = &chunk->Trips[chunk->Count];
+		chunk->Rows[chunk->Count].Key = CSVParseInt(&fields[0]);
+		chunk->Count++;
+
+		trip->BikeID = CSVParseInt(&fields[3]);
+		// convert to min and sec by calling ConvertDuration function
+		trip->TripDuration = ConvertDuration(CSVParseInt(&fields[4]));
+		trip->FromID = CSVParseInt(&fields[5]);
+		trip->ToID = CSVParseInt(&fields[7]);
+		trip->StartTime = CSVParseDateTime(&fields[1]);
+		trip->StopTime = CSVParseDateTime(&fields[2]);
+
+		// every row counts for its bike, and for both of its stations
+		if (chunk->Bikes != NULL) {
+			IDCountsAdd(chunk->Bikes, trip->BikeID, 1);
+			IDCountsAdd(chunk->Stations, trip->FromID, 1);
+			IDCountsAdd(chunk->Stations, trip->ToID, 1);
+		}
+	}
+
+	// the trips don't move anymore, point the rows to them
+	for (i = 0; i < chunk->Count; i++)
+		chunk->Rows[i].Value = &chunk->Trips[i];
+}
+
+
+//
+// thread function of the load: parses the rows of one chunk, then
+// sorts them by id, see AVLSortPairs -- the first row of each id in
+// Rows[0, Unique), the duplicates after them -- so only the sorted
+// chunks are left to merge
+//
+static void _AVLLoadTripChunk(void *arg) {
+
+	TripChunk *chunk = (TripChunk*)arg;
+
+	_AVLParseTripChunk(chunk);
+	chunk->Unique = AVLSortPairs(chunk->Rows, chunk->Count);
+}
+
+
+//
+// adds the partial station counts into the stations tree
+//
+static void _AVLMergeStationCounts(StationTree *stations, IDCounts *counts) {
+
+	STATION *result;
+	int i;
+
+	for (i = 0; i < counts->DenseSize; i++) {
+		if (counts->Dense[i] != 0) {
+			result = StationTreeSearch(stations, i);
+			if (result != NULL)
+				result->TripCount += counts->Dense[i];
+		}
+	}
+
+	for (i = 0; i < CAVLCount(counts->Sparse); i++) {
+		result = StationTreeSearch(stations, counts->Sparse->Nodes[i].Key);
+		if (result != NULL)
+			result->TripCount += counts->SparseCounts[i];
+	}
+}
+
+
+//
+// turns the merged bike counts into the bike values, one per bike
+// with its trip count, and pairs pointing to them; the counts become
+// the index + 1 of each bike's value, see _AVLBikeOf.  Returns the #
+// of bikes.
+//
+static int _AVLCollectBikes(IDCounts *counts, AVLPair *pairs, BIKE *values) {
+
+	int count = 0;
+	int i;
+
+	for (i = 0; i < counts->DenseSize; i++) {
+		if (counts->Dense[i] != 0) {
+			pairs[count].Key = i;
+			values[count].TripCount = counts->Dense[i];
+			counts->Dense[i] = ++count;
+		}
+	}
+	for (i = 0; i < CAVLCount(counts->Sparse); i++) {
+		pairs[count].Key = counts->Sparse->Nodes[i].Key;
+		values[count].TripCount = counts->SparseCounts[i];
+		counts->SparseCounts[i] = ++count;
+	}
+
+	// every trip goes to the list for now, duplicates come off later
+	for (i = 0; i < count; i++) {
+		values[i].FirstTrip = 0;
+		values[i].ListCount = values[i].TripCount;
+		pairs[i].Value = &values[i];
+	}
+
+	return count;
+}
+
+
+//
+// returns the value of the bike, after _AVLCollectBikes
+//
+static BIKE *_AVLBikeOf(IDCounts *index, BIKE *values, AVLKey id) {
+
+	if (id >= 0 && id < IDCOUNTS_MAX)
+		return &values[index->Dense[id] - 1];
+
+	return &values[index->SparseCounts[CAVLSearch(index->Sparse, id)] - 1];
+}
+
+
+//
+// Builds the table with trips, also counts the trips per bike, per
+// station and between each pair of stations, and lists the trips of
+// each bike in bikeTrips.
+//
+// The file is split at row boundaries into one chunk per thread; the
+// threads parse their chunk, count trips per bike and station, and
+// sort their rows by id.  Then the sorted chunks are merged -- a
+// stable merge, in file order, O(N log #threads) -- and the table and
+// its index are bulk built from the result, so the result is the same
+// for any # of threads.  A duplicate trip ID is not inserted, and
+// doesn't count for its stations or route (same as when stations are
+// counted from the trips table), but still counts for its bike.
+// 
+void AVLBuildTripsTree(TripTable *trips, BikeTree *bikes, StationTree *stations, RouteMatrix *routes,
+	TripList *bikeTrips, char *TripsFileName, int threads) {
+
+	MappedFile file;
+	CSVReader reader;
+	CSVField fields[8];
+	TripChunk *chunks;
+	Thread *workers;
+	int *started;			// TRUE if the worker thread is running
+	AVLPair *pairs;
+	int rows = 0;
+	int unique = 0;
+	AVLPair *bikePairs;
+	BIKE *bikeValues;
+	int bikeCount;
+	int offset = 0;
+	int first, dup;
+	int i;
+	double start = TimerNow();
+
+	// map the file
+	if (!MapFile(&file, TripsFileName)) {
+		printf("**Error: unable to open '%s'\n\n", TripsFileName);
+		exit(-1);
+	}
+
+	CSVInit(&reader, file.Data, file.Size);
+	CSVNextRow(&reader, fields, 8);		// skip the header line
+
+	if (threads < 1)
+		threads = 1;
+
+	//
+	// split the rest at row boundaries, chunk i starts with the first
+	// row at or past i/threads of the way through -- a '\n' inside
+	// quotes doesn't end a row:
+	//
+	chunks = (TripChunk*)malloc(sizeof(TripChunk) * threads);
+	workers = (Thread*)malloc(sizeof(Thread) * threads);
+	started = (int*)malloc(sizeof(int) * threads);
+
+	size_t dataSize = reader.End - reader.Cur;
+	for (i = 0; i < threads; i++) {
+		const char *p = reader.Cur + dataSize * i / threads;
+
+		if (i > 0) {
+			if (p < chunks[i - 1].Start)
+				p = chunks[i - 1].Start;
+			p = CSVNextRowStart(chunks[i - 1].Start, p, reader.End);
 		}
+
+		chunks[i].Start = p;
+		if (i > 0)
+			chunks[i - 1].End = p;
+
+		chunks[i].Size = 1024;
+		chunks[i].Count = 0;
+		chunks[i].Trips = (TRIP*)malloc(sizeof(TRIP) * chunks[i].Size);
+		chunks[i].Rows = (AVLPair*)malloc(sizeof(AVLPair) * chunks[i].Size);
+		chunks[i].Bikes = IDCountsCreate();
+		chunks[i].Stations = IDCountsCreate();
 	}
+	chunks[threads - 1].End = reader.End;
 
-	// 
-	// If we get here, tree does not contain key, so insert new node
-	// where we fell out of tree:
 	//
-	AVLNode *newNode = (AVLNode *)malloc(sizeof(AVLNode));
-	newNode->Key = key;
-	newNode->Value = value;
-	newNode->Left = NULL;
-	newNode->Right = NULL;
-	newNode->Height = 0;
+	// parse and sort the chunks, the last one on this thread:
+	//
+	for (i = 0; i < threads - 1; i++) {
+		started[i] = ThreadStart(&workers[i], _AVLLoadTripChunk, &chunks[i]);
+		if (!started[i])
+			_AVLLoadTripChunk(&chunks[i]);		// no thread, do it here
+	}
+	_AVLLoadTripChunk(&chunks[threads - 1]);
+
+	for (i = 0; i < threads - 1; i++) {
+		if (started[i])
+			ThreadJoin(&workers[i]);
+	}
 
 	//
-	// link T where we fell out of tree -- after prev:
+	// gather the sorted chunks in file order, their duplicates after
+	// all of them, merge the chunks and build the trips table:
 	//
-	if (prev == NULL)  // tree is empty, insert @ root:
-	{
-		tree->Root = newNode;
-	}
-	else if (AVLCompareKeys(key, prev->Key) < 0)  // smaller, insert to left:
-	{
-		prev->Left = newNode;
+	for (i = 0; i < threads; i++) {
+		rows += chunks[i].Count;
+		unique += chunks[i].Unique;
 	}
-	else  // larger, insert to right:
-	{
-		prev->Right = newNode;
+
+	pairs = (AVLPair*)malloc(sizeof(AVLPair) * (rows + 1));
+	first = 0;
+	dup = unique;
+	for (i = 0; i < threads; i++) {
+		memcpy(&pairs[first], chunks[i].Rows, sizeof(AVLPair) * chunks[i].Unique);
+		memcpy(&pairs[dup], &chunks[i].Rows[chunks[i].Unique],
+			sizeof(AVLPair) * (chunks[i].Count - chunks[i].Unique));
+		first += chunks[i].Unique;
+		dup += chunks[i].Count - chunks[i].Unique;
+		free(chunks[i].Rows);
 	}
 
-	tree->Count++;
+	// each chunk is a sorted run, so this only merges them; ids in
+	// more than one chunk go into [unique, rows) with the others
+	unique = AVLSortPairs(pairs, unique);
+	TripTableBuild(trips, pairs, unique);
 
 	//
-	// Now walk back up the tree, updating heights and looking for
-	// where the AVL balancing criteria may be broken.  If we reach
-	// a node where the height doesn't change, then we're done -- the
-	// tree is still balanced.  If we reach a node where the AVL 
-	// condition is broken, we fix locally and we're done.  One or two
-	// local rotations is enough to re-balance the tree.
+	// bike trip counts, add them all up in the first chunk, and make
+	// the bike values from them:
 	//
-	AVLNode *N;
-	int      rebalance = _FALSE;  // false by default, e.g. if tree is empty:
+	for (i = 1; i < threads; i++)
+		IDCountsMerge(chunks[0].Bikes, chunks[i].Bikes);
 
-	while (top >= 0)  // stack != empty::
-	{
-		N = stack[top];  // N = pop();
-		top--;
+	bikePairs = (AVLPair*)malloc(sizeof(AVLPair) * (rows + 1));
+	bikeValues = (BIKE*)malloc(sizeof(BIKE) * (rows + 1));
+	bikeCount = _AVLCollectBikes(chunks[0].Bikes, bikePairs, bikeValues);
 
-		int hl = _height(N->Left);
-		int hr = _height(N->Right);
-		int newH = 1 + _max2(hl, hr);
+	//
+	// station trip counts, minus the duplicates left out of the table;
+	// the duplicates stay in their bike's trip count, not in its list:
+	//
+	for (i = 0; i < threads; i++)
+		_AVLMergeStationCounts(stations, chunks[i].Stations);
 
-		if (newH == N->Height)  // heights the same, still an AVL tree::
-		{
-			rebalance = _FALSE;
-			break;
-		}
-		else if (abs(hl - hr) > 1)  // AVL condition broken, we have to fix::
-		{
-			rebalance = _TRUE;
-			break;
-		}
-		else  // update height and continue walking up tree::
-		{
-			N->Height = newH;
-		}
+	for (i = unique; i < rows; i++) {
+		const TRIP *trip = (const TRIP*)pairs[i].Value;
+		STATION *result = StationTreeSearch(stations, trip->FromID);
+		if (result != NULL)
+			result->TripCount--;
+
+		result = StationTreeSearch(stations, trip->ToID);
+		if (result != NULL)
+			result->TripCount--;
+
+		_AVLBikeOf(chunks[0].Bikes, bikeValues, trip->BikeID)->ListCount--;
+	}
+
+	// where each bike's list starts, ListCount back to 0 for the fill
+	for (i = 0; i < bikeCount; i++) {
+		bikeValues[i].FirstTrip = offset;
+		offset += bikeValues[i].ListCount;
+		bikeValues[i].ListCount = 0;
 	}
 
 	//
-	// Okay, does the tree need to be rebalanced?
+	// one pass over the table: count the routes, and drop each row in
+	// its bike's list -- rows are in trip id order, so each list is
+	// sorted too:
 	//
-	if (rebalance)
-	{
-		cur = N;
+	bikeTrips->Count = trips->Count;
+	bikeTrips->Rows = (int*)malloc(sizeof(int) * (bikeTrips->Count + 1));
 
-		//
-		// if we get here, then the AVL condition is broken at "cur".  So we
-		// have to decide which of the 4 cases it is and then rotate to fix.
-		//
+	for (i = 0; i < trips->Count; i++) {
+		BIKE *bike = _AVLBikeOf(chunks[0].Bikes, bikeValues, trips->BikeID[i]);
 
-		// we need cur's parent, so pop the stack one more time
-		if (top < 0)     // stack is empty, ==> N is root
-			prev = NULL;   // flag this with prev == NULL
-		else  // stack not empty, so obtain ptr to cur's parent:
-			prev = stack[top];
+		RouteMatrixAdd(routes, trips->FromID[i], trips->ToID[i], 1);
+		bikeTrips->Rows[bike->FirstTrip + bike->ListCount] = i;
+		bike->ListCount++;
+	}
 
-		//
-		// which of the 4 cases?
-		//
-		if (AVLCompareKeys(newNode->Key, cur->Key) < 0)  // case 1 or 2:
-		{
-			// case 1 or case 2?  either way, we know cur->left exists:
-			AVLNode *L = cur->Left;
+	// the values are final, build the bikes tree from them
+	AVLBulkLoad(&bikes->Base, bikePairs, bikeCount);
+	free(bikePairs);
+	free(bikeValues);
 
-			if (AVLCompareKeys(newNode->Key, L->Key) > 0)
-			{
-				// case 2: left rotate @L followed by a right rotate @cur:
-				cur->Left = LeftRotate(L);
-			}
+	// free the memory
+	for (i = 0; i < threads; i++) {
+		free(chunks[i].Trips);
+		IDCountsFree(chunks[i].Bikes);
+		IDCountsFree(chunks[i].Stations);
+	}
+	free(chunks);
+	free(workers);
+	free(started);
+	free(pairs);
 
-			// case 1 or 2:  right rotate @cur
-			if (prev == NULL)
-				tree->Root = RightRotate(cur);
-			else if (prev->Left == cur)
-				prev->Left = RightRotate(cur);
-			else
-				prev->Right = RightRotate(cur);
-		}
-		else
-		{
-			//
-			// case 3 or case 4?  either way, we know cur->right exists:
-			//
-			AVLNode *R = cur->Right;
+	CSVReportThroughput(TripsFileName, file.Size, rows, TimerNow() - start);
+	UnmapFile(&file);		// release the file
 
-			if (AVLCompareKeys(newNode->Key, R->Key) < 0)
-			{
-				// case 3: right rotate @R followed by a left rotate @cur:
-				cur->Right = RightRotate(R);
-			}
+	PERF_STOP(PerfLoadTrips, start);
+}
 
-			// case 3 or case 4:  left rotate @cur:
-			if (prev == NULL)
-				tree->Root = LeftRotate(cur);
-			else if (prev->Left == cur)
-				prev->Left = LeftRotate(cur);
-			else
-				prev->Right = LeftRotate(cur);
+
+// 
+// search the tree for stations in the distance range specified by user
+// returns pointer to the array when they are stored; queries use the
+// k-d tree (see KDFindClosestStations), this is its brute-force
+// baseline in --bench
+//
+ClosestStations *AVLFindClosestStations(AVLNode *stations, Coords userLocation,
+								double distance, ClosestStations *closestStations) {
+	AVLIterator iter;
+	AVLNode *station;
+
+	AVLIteratorInit(&iter, stations, AVLPreOrder);
+
+	while ((station = AVLIteratorNext(&iter)) != NULL) {
+		// compute the distance
+		double actualDistance = distBetween2Points(StationValue(station)->Coordinates.latitude,
+			StationValue(station)->Coordinates.longtitude,
+			userLocation.latitude, userLocation.longtitude);
+
+		// check if station in range, insert into array of yes
+		if (actualDistance <= distance) {
+
+			// update count
+			closestStations->count++;
+			// grow size if needed
+			if (closestStations->count > closestStations->size)
+				GrowClosestStations(closestStations);
+
+			// add to array
+			closestStations->stations[closestStations->count-1].distance = actualDistance;
+			closestStations->stations[closestStations->count-1].stationID = station->Key;
 		}
 	}
-
-	//
-	// done:
-	//
-//	free(newNode);
-	return _TRUE;  // success:
+	
+	// return array
+	return closestStations;
 }
 
+
 //
-// AVLSearch: searches the binary search tree for a node containing the
-// same key.  If a match is found, a pointer to the node is returned, 
-// otherwise NULL is returned.
+// Scans the trips and counts number of trips from source set to destination set
 //
-AVLNode *AVLSearch(AVL *tree, AVLKey key)
-{	
-	// cur as tree->Root
-	AVLNode *cur = tree->Root;
+void AVLCountTrips(IDList *sources, IDList *destinations, TripTable *trips, int *count) {
 
-	if (cur == NULL) {
-		return NULL;		// not found
-	}
-	else {
-		while (cur != NULL) {
-			if (key == cur->Key) {		// found, return cur
-				return cur;		
-			}
-			else if (key < cur->Key) {	// go left
-				cur = cur->Left;
-			}
-			else {						// go right
-				cur = cur->Right;
-			}
-		}
-	}
+	int row;
 
-	return NULL;			// not found
+	for (row = 0; row < trips->Count; row++) {
+		// source matches, and destination also matches => increment counter
+		if (SearchArray(sources, trips->FromID[row])
+			&& SearchArray(destinations, trips->ToID[row]))
+			*count = *count + 1;
+	}
 }
 
 
+// a trip's start time and row, for sorting by time
+typedef struct TimeRow
+{
+	long long	Time;
+	int			Row;
+} TimeRow;
 
 //
-// Builds the tree with stations, return pointer to the handle
-// 
-void AVLBuildStationsTree(AVL *tree, char *StationsFileName) {
+// orders trips by start time, secondary by row, i.e. by id
+//
+static int _AVLCompareStartTimes(const void *a, const void *b) {
 
-	// open file
-	FILE *pStationsFile = fopen(StationsFileName, "r");
-	char line[512];
-	char *token;
-	AVLNode *temp = (AVLNode*)malloc(sizeof(AVLNode));
-	int status = -1;		// insertion status
+	const TimeRow *t1 = (const TimeRow*)a;
+	const TimeRow *t2 = (const TimeRow*)b;
 
-	
+	if (t1->Time < t2->Time)
+		return -1;
+	else if (t1->Time > t2->Time)
+		return 1;
+	else
+		return (t1->Row > t2->Row) - (t1->Row < t2->Row);
+}
 
-	fgets(line, 512, pStationsFile);	// skip the header line
-	fgets(line, 512, pStationsFile);	// read in first line with data
-
-	while (!feof(pStationsFile)) {
-		temp->Value.Type = STATIONTYPE;		// specify the type
-		line[strcspn(line, "\r\n")] = '\0';	// avoid errors on different platforms
-		token = strtok(line, ",");			// parse id
-		// convert to int and store into key
-		temp->Key = atoi(token);
-		token = strtok(NULL, ",");			//	grab next token
-		temp->Value.Station.Name = (char*)malloc((sizeof(char) * (strlen(token) + 1)));
-		strcpy(temp->Value.Station.Name, token);
-		token = strtok(NULL, ",");			//	grab next token
-		temp->Value.Station.Coordinates.latitude = atof(token);
-		token = strtok(NULL, ",");			//	grab next token
-		temp->Value.Station.Coordinates.longtitude = atof(token);
-		token = strtok(NULL, ",");			//	grab next token
-		temp->Value.Station.Capacity = atoi(token);
 
-		// initialize tripCount to 0
-		temp->Value.Station.TripCount = 0;
+//
+// AVLBuildTimeIndex:
+//
+// Lists the trip rows by start time, secondary by id, in byTime.
+//
+void AVLBuildTimeIndex(TripTable *trips, TripList *byTime) {
 
-		// insert
-		AVLInsert(tree, temp->Key, temp->Value);
+	int row;
 
-		if (status == 0)
-			printf("Insertion failed.\n");
+	byTime->Count = trips->Count;
+	byTime->Rows = (int*)malloc(sizeof(int) * (byTime->Count + 1));
 
-		fgets(line, 512, pStationsFile);	// read in next line
+	// trip ids are about time ordered, so this is almost sorted already
+	TimeRow *times = (TimeRow*)malloc(sizeof(TimeRow) * (byTime->Count + 1));
+	for (row = 0; row < trips->Count; row++) {
+		times[row].Time = trips->StartTime[row];
+		times[row].Row = row;
 	}
-	free(temp);
-		
-	fclose(pStationsFile);		// close the file
-}
 
+	qsort(times, byTime->Count, sizeof(TimeRow), _AVLCompareStartTimes);
+
+	for (row = 0; row < byTime->Count; row++)
+		byTime->Rows[row] = times[row].Row;
 
+	free(times);
+}
 
 
 //
-// Builds the tree with trips, return pointer to the handle
-// 
-void AVLBuildTripsTree(AVL *trips, AVL *bikes, char *TripsFileName) {
+// AVLTimeIndexFirst:
+//
+// Returns the index of the first trip in byTime that starts at or
+// after time, byTime->Count if there is none.  Binary search.
+//
+int AVLTimeIndexFirst(TripTable *trips, TripList *byTime, long long time) {
 
-	// open file
-	FILE *pTripsFile = fopen(TripsFileName, "r");
-	char line[512];
-	char *token;
-	AVLNode *tempTrip = (AVLNode*)malloc(sizeof(AVLNode));
-	//AVLNode *tempBike = (AVLNode*)malloc(sizeof(AVLNode));
+	int lo = 0, hi = byTime->Count;
 
-	int status = -1;		// insertion status
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
 
+		if (trips->StartTime[byTime->Rows[mid]] < time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
+	return lo;
+}
 
-	fgets(line, 512, pTripsFile);	// skip the header line
-	fgets(line, 512, pTripsFile);	// read in first line with data
 
-	while (!feof(pTripsFile)) {
-		tempTrip->Value.Type = TRIPTYPE;		// specify the type
-		line[strcspn(line, "\r\n")] = '\0';	// avoid errors on different platforms
-		token = strtok(line, ",");			// parse id
-		// convert to int and store into key
-		tempTrip->Key = atoi(token);
-		token = strtok(NULL, ",");			//	skip start date and time
-		token = strtok(NULL, ",");			//	skip stop date and time
-		token = strtok(NULL, ",");			//	grab BikeID
-		// convert to int and store into BikeID
-		tempTrip->Value.Trip.BikeID = atoi(token);
-		// convert to int and store into FromID
+//
+// merges the new rows into the time index: sorts them by start time,
+// then merges from the back, so nothing moves below the first new one
+//
+static void _AVLAddToTimeIndex(TripTable *trips, TripList *byTime, int *rows, int count) {
 
-		token = strtok(NULL, ",");			//	grab TripDuration
-		int seconds = atoi(token);			// convert to int
-		// convert to min and sec by calling ConvertDuration function
-		tempTrip->Value.Trip.TripDuration = ConvertDuration(seconds);
-		token = strtok(NULL, ",");			//	grab FromID
-		// convert to int and store into FromID
-		tempTrip->Value.Trip.FromID = atoi(token);
-		token = strtok(NULL, ",");			//	skip station name
-		token = strtok(NULL, ",");			//	grab ToID
-		// convert to int and store into ToID
-		tempTrip->Value.Trip.ToID = atoi(token);
+	int i, j, w;
 
+	TimeRow *times = (TimeRow*)malloc(sizeof(TimeRow) * (count + 1));
+	for (j = 0; j < count; j++) {
+		times[j].Time = trips->StartTime[rows[j]];
+		times[j].Row = rows[j];
+	}
 
-		// insert
-		AVLInsert(trips, tempTrip->Key, tempTrip->Value);
+	qsort(times, count, sizeof(TimeRow), _AVLCompareStartTimes);
 
-		// insert into bikes tree is needed
-		AVLNode *result = AVLSearch(bikes, tempTrip->Value.Trip.BikeID);
-		if (result == NULL) {
-			// fill out the info about the bike
-			AVLNode *tempInsert = (AVLNode*)malloc(sizeof(AVLNode));
-			tempInsert->Value.Type = BIKETYPE;		// specify the type
-			tempInsert->Key = tempTrip->Value.Trip.BikeID;
-			tempInsert->Value.Bike.TripCount = 1;
-			// insert
-			AVLInsert(bikes, tempInsert->Key, tempInsert->Value);
-			// free the memory
-			free(tempInsert);
-		}
-		else							// already inserted, increment count
-			result->Value.Bike.TripCount++;
+	byTime->Rows = (int*)realloc(byTime->Rows, sizeof(int) * (byTime->Count + count + 1));
 
-		if (status == 0)				// failed
-			printf("Insertion failed.\n");
+	i = byTime->Count - 1;
+	j = count - 1;
+	w = byTime->Count + count - 1;
+	while (j >= 0) {
+		TimeRow last;
+		last.Time = (i >= 0) ? trips->StartTime[byTime->Rows[i]] : 0;
+		last.Row = (i >= 0) ? byTime->Rows[i] : 0;
 
-		fgets(line, 512, pTripsFile);	// read in next line
+		if (i >= 0 && _AVLCompareStartTimes(&last, &times[j]) > 0)
+			byTime->Rows[w--] = byTime->Rows[i--];
+		else
+			byTime->Rows[w--] = times[j--].Row;
 	}
-	free(tempTrip);
-	// fclose(TripsFileName);
+
+	byTime->Count += count;
+	free(times);
 }
 
 
-// 
-// Updates the stations tree counts,
-// Performs pre order traversal of trips tree, 
-// searches for id in stations and update if necessary
+// a trip's bike and row, for grouping new rows by bike
+typedef struct BikeRow
+{
+	int			BikeID;
+	int			Row;
+} BikeRow;
+
+//
+// orders trips by bike, secondary by row
 //
-void AVLUpdateStationsTree(AVL *stations, AVLNode *trips) {
+static int _AVLCompareBikeRows(const void *a, const void *b) {
 
-	AVLNode *cur = trips;
+	const BikeRow *r1 = (const BikeRow*)a;
+	const BikeRow *r2 = (const BikeRow*)b;
 
-	// base case
-	if (cur == NULL)
-		return;
-	
+	if (r1->BikeID != r2->BikeID)
+		return (r1->BikeID > r2->BikeID) - (r1->BikeID < r2->BikeID);
+	else
+		return (r1->Row > r2->Row) - (r1->Row < r2->Row);
+}
+
+
+//
+// the bikes tree is rebuilt with the new trip counts and lists: every
+// list is copied bike by bike into a new array, merged with its new
+// rows, so every list stays sorted by row, and bikes not in the tree
+// yet come in too.  added is sorted, see _AVLAddBikeTrips.  Returns #
+// of new bikes.
+//
+static int _AVLRebuildBikeTrips(BikeTree *bikes, TripList *bikeTrips, BikeRow *added, int count) {
+
+	AVLNode *bike;
+	AVLIterator iter;
+	AVLPair *pair;
+	BIKE *value;
+	int offset = 0;
+	int newBikes = 0;
+	int i, j = 0, n = 0;
+
+	AVLPair *pairs = (AVLPair*)malloc(sizeof(AVLPair) * (AVLCount(&bikes->Base) + count + 1));
+	BIKE *values = (BIKE*)malloc(sizeof(BIKE) * (AVLCount(&bikes->Base) + count + 1));
+	int *merged = (int*)malloc(sizeof(int) * (bikeTrips->Count + count + 1));
+
+	AVLIteratorInit(&iter, bikes->Base.Root, AVLInOrder);
+	bike = AVLInOrderNext(&iter);
+
+	while (bike != NULL || j < count) {
+		int *old = NULL;
+		int oldCount = 0;
+
+		// next bike of the tree or of the rows, whichever is smaller
+		pair = &pairs[n];
+		value = &values[n];
+		n++;
+		pair->Key = (bike != NULL && (j == count || bike->Key <= added[j].BikeID)) ?
+			bike->Key : added[j].BikeID;
+		pair->Value = value;
+		value->TripCount = 0;
+
+		if (bike != NULL && bike->Key == pair->Key) {
+			value->TripCount = BikeValue(bike)->TripCount;
+			old = &bikeTrips->Rows[BikeValue(bike)->FirstTrip];
+			oldCount = BikeValue(bike)->ListCount;
+			bike = AVLInOrderNext(&iter);
+		}
+		else
+			newBikes++;
 
-	// search for FromID
-	AVLNode *result = AVLSearch(stations, cur->Value.Trip.FromID);
-	if (result != NULL)
-		result->Value.Station.TripCount++;
+		while (j < count && added[j].BikeID == pair->Key && added[j].Row < 0) {
+			value->TripCount++;
+			j++;
+		}
+
+		value->FirstTrip = offset;
+		for (i = 0; i < oldCount || (j < count && added[j].BikeID == pair->Key); ) {
+			if (j == count || added[j].BikeID != pair->Key || (i < oldCount && old[i] < added[j].Row))
+				merged[offset++] = old[i++];
+			else
+				merged[offset++] = added[j++].Row;
+		}
+		value->ListCount = offset - value->FirstTrip;
+	}
 
-	// search for ToID
-	result = AVLSearch(stations, cur->Value.Trip.ToID);
-	if (result != NULL)
-		result->Value.Station.TripCount++;
+	AVLRebuild(&bikes->Base, pairs, n);
 
-	// recursively visit Right Sub tree
-	AVLUpdateStationsTree(stations, trips->Right);
+	free(bikeTrips->Rows);
+	bikeTrips->Rows = merged;
+	bikeTrips->Count = offset;
 
-	// recursively visit Left Sub tree
-	AVLUpdateStationsTree(stations, trips->Left);
+	free(pairs);
+	free(values);
+	return newBikes;
 }
 
 
-// 
-// search the tree for stations in the distance range specified by user
-// returns pointer to the array when they are stored
 //
-ClosestStations *AVLFindClosestStations(AVLNode *stations, Coords userLocation,
-								double distance, ClosestStations *closestStations) {
-	// base case 
-	if (stations == NULL)
-		return closestStations;
+// the bikes tree gets a new version with the new trip counts and
+// lists.  added has an entry with Row -1 for every row parsed, which
+// counts for its bike, and one with its row for every new trip.  Only
+// the bikes of added change: the list of each one with new trips,
+// merged with them so it stays sorted by row, goes after the lists in
+// Rows, and the bikes are updated or inserted, see AVLMerge.  The
+// lists left behind stay unused until they would be more than the
+// tableRows rows in use; then every list is copied into a new array
+// and the tree rebuilt instead.  The table of the bikes by ID follows.
+// Returns # of new bikes.
+//
+static int _AVLAddBikeTrips(BikeTree *bikes, TripList *bikeTrips, IDTable **table, BikeRow *added,
+	int count, int tableRows) {
+
+	AVLPair *pairs;
+	BIKE *values;
+	BIKE *old;
+	BIKE *value;
+	int *oldRows;
+	int oldCount;
+	int need = 0;
+	int newBikes;
+	int i, j, n = 0;
+
+	// by bike, the rows that only count first
+	qsort(added, count, sizeof(BikeRow), _AVLCompareBikeRows);
+
+	// room for the moved lists, and # of bikes
+	for (j = 0; j < count; j++) {
+		if (j == 0 || added[j].BikeID != added[j - 1].BikeID) {
+			old = BikeTreeSearch(bikes, added[j].BikeID);
+			need += (old != NULL) ? old->ListCount : 0;
+			n++;
+		}
+		need += (added[j].Row >= 0);
+	}
 
-	// compute the distance
-	double actualDistance = distBetween2Points(stations->Value.Station.Coordinates.latitude,
-		stations->Value.Station.Coordinates.longtitude,
-		userLocation.latitude, userLocation.longtitude);
+	if ((long long)bikeTrips->Count + need > 2LL * tableRows) {
+		newBikes = _AVLRebuildBikeTrips(bikes, bikeTrips, added, count);
+		IDTableFree(*table);
+		*table = IDTableBuild(&bikes->Base);
+		return newBikes;
+	}
+
+	pairs = (AVLPair*)malloc(sizeof(AVLPair) * (n + 1));
+	values = (BIKE*)malloc(sizeof(BIKE) * (n + 1));
+	bikeTrips->Rows = (int*)realloc(bikeTrips->Rows, sizeof(int) * (bikeTrips->Count + need + 1));
 
-	// check if station in range, insert into array of yes
-	if (actualDistance <= distance) {
+	for (j = 0, n = 0; j < count; n++) {
+		value = &values[n];
+		pairs[n].Key = added[j].BikeID;
+		pairs[n].Value = value;
+
+		old = BikeTreeSearch(bikes, pairs[n].Key);
+		if (old != NULL) {
+			*value = *old;
+			oldRows = &bikeTrips->Rows[old->FirstTrip];
+			oldCount = old->ListCount;
+		}
+		else {
+			value->TripCount = 0;
+			value->FirstTrip = 0;
+			value->ListCount = 0;
+			oldRows = NULL;
+			oldCount = 0;
+		}
 
-		// update count
-		closestStations->count++;
-		// grow size if needed
-		if (closestStations->count > closestStations->size)
-			GrowClosestStations(closestStations);
+		while (j < count && added[j].BikeID == pairs[n].Key && added[j].Row < 0) {
+			value->TripCount++;
+			j++;
+		}
 
-		// add to array
-		closestStations->stations[closestStations->count-1].distance = actualDistance;
-		closestStations->stations[closestStations->count-1].stationID = stations->Key;
+		// new trips: the merged list goes at the end
+		if (j < count && added[j].BikeID == pairs[n].Key) {
+			value->FirstTrip = bikeTrips->Count;
+			for (i = 0; i < oldCount || (j < count && added[j].BikeID == pairs[n].Key); ) {
+				if (j == count || added[j].BikeID != pairs[n].Key
+					|| (i < oldCount && oldRows[i] < added[j].Row))
+					bikeTrips->Rows[bikeTrips->Count++] = oldRows[i++];
+				else
+					bikeTrips->Rows[bikeTrips->Count++] = added[j++].Row;
+			}
+			value->ListCount = bikeTrips->Count - value->FirstTrip;
+		}
 	}
 
-	// traverse left sub tree
-	AVLFindClosestStations(stations->Left, userLocation,
-		distance, closestStations);
+	newBikes = AVLMerge(&bikes->Base, pairs, n);
+	*table = IDTableUpdate(*table, &bikes->Base, pairs, n);
 
-	// traverse left subtree
-	AVLFindClosestStations(stations->Right, userLocation,
-		distance, closestStations);
-	
-	// return array
-	return closestStations;
+	free(pairs);
+	free(values);
+	return newBikes;
 }
 
 
 //
-// builds the array with stations in the given range from given station
+// orders ids
 //
-void AVLBuildSubSet(IDList *list, Coords coords, AVLNode *stations, double distance) {
+static int _AVLCompareIDs(const void *a, const void *b) {
+
+	int id1 = *(const int*)a;
+	int id2 = *(const int*)b;
+
+	return (id1 > id2) - (id1 < id2);
+}
 
-	// base case
-	if (stations == NULL)
-		return;
 
-	// compute the distance
-	double actualDistance = distBetween2Points(stations->Value.Station.Coordinates.latitude,
-							stations->Value.Station.Coordinates.longtitude,
-							coords.latitude, coords.longtitude);
+//
+// the stations tree gets a new version with the counts of the new
+// trips, which copies only the stations they go from or to; so does
+// the table of the stations by ID
+//
+static void _AVLAddStationTrips(StationTree *stations, IDTable **table, TripTable *trips,
+	int *rows, int count) {
 
-	// add to arr
-	if (actualDistance <= distance) {
-		list->count++;					// increment count
-		if (list->count > list->size)	// size too small, increase size
-			GrowIDList(list);
+	AVLNode *station;
+	int i, first, n = 0;
 
-		// insert into array
-		list->arr[list->count - 1] = stations->Key;
+	int *ids = (int*)malloc(sizeof(int) * (2 * count + 1));
+	AVLPair *pairs = (AVLPair*)malloc(sizeof(AVLPair) * (2 * count + 1));
+	STATION *values = (STATION*)malloc(sizeof(STATION) * (2 * count + 1));
+
+	for (i = 0; i < count; i++) {
+		ids[2 * i] = trips->FromID[rows[i]];
+		ids[2 * i + 1] = trips->ToID[rows[i]];
+	}
+
+	qsort(ids, 2 * count, sizeof(int), _AVLCompareIDs);
+
+	for (i = 0; i < 2 * count; ) {
+		station = AVLSearch(&stations->Base, ids[i]);
+
+		for (first = i; i < 2 * count && ids[i] == ids[first]; i++)
+			;
+
+		if (station != NULL) {
+			values[n] = *StationValue(station);
+			values[n].TripCount += i - first;
+			pairs[n].Key = station->Key;
+			pairs[n].Value = &values[n];
+			n++;
+		}
 	}
-	
-	// visit left subtree
-	AVLBuildSubSet(list, coords, stations->Left, distance);
 
-	// visit right sub tree
-	AVLBuildSubSet(list, coords, stations->Right, distance);
+	AVLUpdate(&stations->Base, pairs, n);
+	*table = IDTableUpdate(*table, &stations->Base, pairs, n);
+
+	free(ids);
+	free(pairs);
+	free(values);
 }
 
 
 //
-// Traverse the tree and counts number of trips from source set to destination set
+// AVLAppendTrips:
+//
+// Adds the trips of size bytes of trips file rows (no header) to the
+// loaded data.  A row of a trip already in the table is the same trip
+// read again -- a replaced file, read from the start -- and is skipped
+// before anything is counted.  The other rows have the same result as
+// if they had been at the end of the trips file at load time: a trip
+// with a new id goes into the table and counts for its stations and
+// route, a duplicate doesn't, and every row counts for its bike, which
+// is inserted if it is new.
 //
-void AVLCountTrips(IDList *sources, IDList *destinations, AVLNode *trips, int *count) {
+// Only the new rows are parsed and searched for.  The rows of the new
+// trips are merged into the time index from the back -- new trips are
+// mostly the latest ones, so little moves -- and into the lists of
+// their bikes, which move to the end (see _AVLAddBikeTrips).  While a
+// version of a tree is held (see AVLVersionTake), the stations and the
+// bikes get new versions that copy only the ones that changed -- new
+// bikes are inserted into the same version -- so the versions taken
+// before keep the old counts, and node pointers from before may point
+// to replaced copies after; else they change in place, see the read
+// path.  The tables by ID (see IDTableBuild) are
+// brought up to date with the trees, NULL is fine.  Reports what was
+// added in stats.
+//
+void AVLAppendTrips(TripTable *trips, BikeTree *bikes, StationTree *stations, RouteMatrix *routes,
+	TripList *bikeTrips, TripList *byTime, IDTable **bikeTable, IDTable **stationTable,
+	const char *data, size_t size, AppendStats *stats) {
+
+	TripChunk chunk;
+	int *moved;
+	int fresh = 0, added;
+	int i;
+	PERF_START(start);
+
+	memset(stats, 0, sizeof(AppendStats));
+
+	// parse the rows
+	chunk.Start = data;
+	chunk.End = data + size;
+	chunk.Size = 1024;
+	chunk.Count = 0;
+	chunk.Trips = (TRIP*)malloc(sizeof(TRIP) * chunk.Size);
+	chunk.Rows = (AVLPair*)malloc(sizeof(AVLPair) * chunk.Size);
+	chunk.Bikes = NULL;			// the counts come from the trees, see below
+	chunk.Stations = NULL;
+
+	_AVLParseTripChunk(&chunk);
+
+	AVLPair *pairs = chunk.Rows;
+	stats->Rows = chunk.Count;
+
+	// drop the rows of trips already in the table, they count for nothing
+	for (i = 0; i < chunk.Count; i++) {
+		if (TripTableFind(trips, pairs[i].Key) < 0)
+			pairs[fresh++] = pairs[i];
+	}
 
-	// result indicator, exist in set or not
-	int resultSource = 0;
-	int resultDest = 0;
-	
-	// NULL, return
-	if (trips == NULL)
-		return;
+	// every other row counts for its bike, see _AVLAddBikeTrips
+	BikeRow *bikeRows = (BikeRow*)malloc(sizeof(BikeRow) * (2 * fresh + 1));
+	for (i = 0; i < fresh; i++) {
+		bikeRows[i].BikeID = ((const TRIP*)pairs[i].Value)->BikeID;
+		bikeRows[i].Row = -1;
+	}
+
+	// the new trips: first row of each id
+	added = AVLSortPairs(pairs, fresh);
+
+	int *rows = (int*)malloc(sizeof(int) * (added + 1));
+	TripTableInsert(trips, pairs, added, rows, &moved);
+
+	// some went before existing trips, renumber the rows in the lists
+	if (moved != NULL) {
+		for (i = 0; i < bikeTrips->Count; i++)
+			bikeTrips->Rows[i] = moved[bikeTrips->Rows[i]];
+		for (i = 0; i < byTime->Count; i++)
+			byTime->Rows[i] = moved[byTime->Rows[i]];
+		free(moved);
+		stats->Moved = TRUE;
+	}
 
-	// check sources array
-	resultSource = SearchArray(*&sources, trips->Value.Trip.FromID);
+	// route counts of the new trips, and their rows by bike
+	for (i = 0; i < added; i++) {
+		RouteMatrixAdd(routes, trips->FromID[rows[i]], trips->ToID[rows[i]], 1);
 
-	if (resultSource) {		// source matches, search destinations array
-		resultDest = SearchArray(*&destinations, trips->Value.Trip.ToID);
-		if (resultDest)
-			*count = *count + 1;		// destination also matches, increment counter
+		bikeRows[fresh + i].BikeID = trips->BikeID[rows[i]];
+		bikeRows[fresh + i].Row = rows[i];
 	}
 
-	// visit left subtree
-	AVLCountTrips(sources, destinations, trips->Left, *&count);
+	if (added > 0)
+		_AVLAddStationTrips(stations, stationTable, trips, rows, added);
+	if (fresh > 0)
+		stats->NewBikes = _AVLAddBikeTrips(bikes, bikeTrips, bikeTable, bikeRows, fresh + added,
+			TripTableCount(trips));
+	_AVLAddToTimeIndex(trips, byTime, rows, added);
+
+	stats->Inserted = added;
 
-	// visit right subtree
-	AVLCountTrips(sources, destinations, trips->Right, *&count);
-}
\ No newline at end of file
+	// free the memory
+	free(chunk.Trips);
+	free(chunk.Rows);
+	free(bikeRows);
+	free(rows);
+
+	PERF_STOP(PerfAppendTrips, start);
+}
@@ -11,6 +11,10 @@
 // make sure this header file is #include exactly once:
 #pragma once
 
+#include <limits.h>
+
+#include "avltyped.h"
+
 #define TRUE 1
 #define FALSE 0
 
@@ -48,6 +52,8 @@ typedef struct TRIP
 	int		FromID;
 	int		ToID;
 	Duration TripDuration;
+	long long StartTime;	// seconds since 1970-01-01 00:00, -1 => unknown
+	long long StopTime;
 
 } TRIP;
 
@@ -55,46 +61,116 @@ typedef struct TRIP
 typedef struct BIKE
 {
 	int  TripCount;
+	int  FirstTrip;		// this bike's trips are TripList.Rows[FirstTrip,
+	int  ListCount;		// FirstTrip + ListCount), duplicates left out
 
 } BIKE;
 
-// union types
-enum UNIONTYPE
-{
-	STATIONTYPE,
-	TRIPTYPE,
-	BIKETYPE
-};
-
-// AVLValue struct
-typedef struct AVLValue
-{
-	enum UNIONTYPE Type;  // Station, Trip, or Bike:
-	union
-	{
-		STATION  Station;   // union => only ONE of these is stored:
-		TRIP     Trip;
-		BIKE     Bike;
-	};
-} AVLValue;
-
-// AVLNode struct
+// AVLNode struct, the value -- ValueSize bytes of the tree's type, see
+// AVLInit -- follows the node in memory, see AVL_NODE_VALUE
 typedef struct AVLNode
 {
 	AVLKey    Key;
-	AVLValue  Value;
 	struct AVLNode  *Left;
 	struct AVLNode  *Right;
 	int       Height;
+	int       Size;			// # of nodes in this sub-tree
 } AVLNode;
 
+#define AVL_NODE_VALUE(node) ((void*)((AVLNode*)(node) + 1))
+
+// block of nodes, see the node arena in avl.c
+typedef struct AVLChunk
+{
+	struct AVLChunk *Next;
+	int       Used;
+	int       Size;
+	AVLNode   Nodes[1];		// really Size nodes of NodeSize bytes
+} AVLChunk;
+
+// node replaced by a new version, see the read path in avl.c
+typedef struct AVLRetired
+{
+	AVLNode   *Node;
+	long long  Epoch;		// reusable once no reader is in this epoch or before
+} AVLRetired;
+
+// version of a tree kept whole while it is held, see AVLVersionTake
+typedef struct AVLVersion
+{
+	AVLNode   *Root;
+	long long  Epoch;		// nodes retired in or after it are kept, 0 => free
+	int        Refs;		// holders, -1 => being taken or released
+	struct AVLVersion *Next;	// all versions of the tree
+} AVLVersion;
+
 // AVL Struct / tree handle
 typedef struct AVL
 {
-	AVLNode *Root;
-	int      Count;
+	AVLNode  *Root;			// swapped atomically by AVLInsert, see AVLRoot
+	int       Count;
+	AVLChunk *Chunks;		// node arena, newest chunk first
+	AVLNode  *Free;			// reclaimed nodes, linked by Left, reused first
+	AVLRetired *Retired;	// replaced nodes readers may still see
+	int       RetiredCount;
+	int       RetiredSize;
+	AVLVersion *Versions;	// taken so far, reused once released
+	int       Shared;		// TRUE => read by other threads, see AVLShare
+	int       ValueSize;	// bytes of each node's value
+	int       NodeSize;		// the node and its value, padded
 } AVL;
 
+// the typed trees of the loaded data, see avltyped.h
+AVL_TYPED_TREE_DECLARE(Station, STATION)
+AVL_TYPED_TREE_DECLARE(Bike, BIKE)
+AVL_TYPED_INSERT_DECLARE(Bike, BIKE)		// the stress test inserts one by one
+
+// traversal orders
+typedef enum AVLOrder
+{
+	AVLInOrder,			// left, node, right => ascending keys
+	AVLPreOrder,		// node, left, right
+	AVLPostOrder		// left, right, node
+} AVLOrder;
+
+// an AVL tree of N nodes is at most 1.44 log2(N) high, so 64 levels
+// are plenty for anything that fits in memory
+#define AVL_MAX_HEIGHT 64
+
+// traversal state, see AVLIteratorNext
+typedef struct AVLIterator
+{
+	AVLOrder  Order;
+	AVLNode  *Stack[AVL_MAX_HEIGHT + 2];
+	int       Top;			// -1 => done, else Stack[Top] is next
+} AVLIterator;
+
+// rows of the trip table, grouped by bike (see BIKE) or by start time;
+// after appends the bike lists may have unused rows between them, so
+// Count can be more than the # of trips, see AVLAppendTrips
+typedef struct TripList
+{
+	int      *Rows;
+	int       Count;
+} TripList;
+
+// what AVLAppendTrips added
+typedef struct AppendStats
+{
+	int Rows;			// rows parsed
+	int Inserted;		// new trips, the other rows were duplicates
+	int NewBikes;
+	int Moved;			// TRUE if trips went before existing ones, see TripTableInsert
+} AppendStats;
+
+// (key, value) pair, for building a tree in one go; the value is
+// copied into the node
+typedef struct AVLPair
+{
+	AVLKey      Key;
+	const void *Value;
+} AVLPair;
+
 // station info
 typedef struct StationInfo 
 {
@@ -110,14 +186,27 @@ typedef struct ClosestStations
 	int size;
 } ClosestStations;
 
-// keeps info about id's
+// keeps info about id's, set is an open addressing hash set of the
+// same id's for SearchArray(), at most half full: a slot holds 1 + the
+// index of its id in arr, 0 => empty, so any int is a valid id
 typedef struct IDList 
 {
 	int *arr;
 	int count;
 	int size;
+	int *set;
+	int setSize;		// always a power of 2
 } IDList;
 
+// trip counts between stations, see routes.h
+typedef struct RouteMatrix RouteMatrix;
+
+// the trips, one array per column, see triptable.h
+typedef struct TripTable TripTable;
+
+// nodes by ID, see idtable.h
+typedef struct IDTable IDTable;
+
 
 
 
@@ -125,19 +214,24 @@ typedef struct IDList
 // main.c
 // function prototypes 
 //
-void DisplayStationInfo(AVLNode *station);
-void DisplayTripInfo(AVLNode *trip);
-void DisplayBikeInfo(AVLNode *bike);
-void DisplayClosestStations(ClosestStations *closestStations);
-void DisplayRouteStats(int tripCount, int sourceID, int destID, int totalTrips);
+int CountRouteTrips(TripTable *trips, TripList *byTime, long long from, long long to,
+	IDList *sources, IDList *destinations, int *windowTrips);
+int CountStationTrips(TripTable *trips, TripList *byTime, long long from, long long to,
+	int stationID);
 void InitializeClosestStations(ClosestStations *closestStations);
 double distBetween2Points(double lat1, double long1, double lat2, double long2);
 void GrowClosestStations(ClosestStations *closestStations);
 void GrowIDList(IDList *list);
-void SelectionSort(ClosestStations *closestStations);
+int CompareStationInfo(const void *a, const void *b);
+void SortClosestStations(ClosestStations *closestStations);
+void KeepClosestStations(ClosestStations *closestStations, int k);
 int SearchArray(IDList *sources, int id);
 IDList *InitializeIDList();
+void AddToIDList(IDList *list, int id);
+void FreeIDList(IDList *list);
 Duration ConvertDuration(int seconds);
+void CollectKeys(AVLNode *node, AVLKey *keys, int *count);
+AVL *SelectTree(char *name, StationTree *stations, BikeTree *bikes);
 
 
 
@@ -145,16 +239,72 @@ Duration ConvertDuration(int seconds);
 // AVL API: 
 // function prototypes
 //
-AVL *AVLCreate();
+void AVLInit(AVL *tree, int valueSize);
+void AVLReadBegin();		// concurrent reads, only the stress test uses them
+void AVLReadEnd();
+AVLNode *AVLRoot(AVL *tree);
+void AVLShare(AVL *tree);
+AVLVersion *AVLVersionTake(AVL *tree);
+void AVLVersionRelease(AVLVersion *version);
+int AVLVersionHeld(AVL *tree, AVLVersion *version);
+void AVLVersionUsage(AVL *tree, int *versions, int *held);
 AVLNode *AVLSearch(AVL *tree, AVLKey key);
 ClosestStations *AVLFindClosestStations(AVLNode *stations, Coords userLocation, double distance, ClosestStations *closestStations);
 int AVLCompareKeys(AVLKey key1, AVLKey key2);
-int AVLInsert(AVL *tree, AVLKey key, AVLValue value);
+int AVLInsert(AVL *tree, AVLKey key, const void *value);
+AVLNode *AVLPersistentInsert(AVL *tree, AVLNode *root, AVLKey key, const void *value,
+	AVLNode **replaced, int *count);
+int AVLUpdate(AVL *tree, AVLPair *pairs, int count);
+int AVLMerge(AVL *tree, AVLPair *pairs, int count);
+void AVLRebuild(AVL *tree, AVLPair *pairs, int count);
+int AVLSortPairs(AVLPair *pairs, int count);
+int AVLBuildFromSorted(AVL *tree, AVLPair *pairs, int count);
+int AVLBulkLoad(AVL *tree, AVLPair *pairs, int count);
 int AVLCount(AVL *tree);
 int AVLHeight(AVL *tree);
-void AVLBuildStationsTree(AVL *tree, char *StationsFileName);
-void AVLBuildTripsTree(AVL *trips, AVL *bikes, char *TripsFileName);
-void AVLUpdateStationsTree(AVL *stations, AVLNode *trips);
-void AVLCountTrips(IDList *sources, IDList *destinations, AVLNode *trips, int *count);
-void AVLBuildSubSet(IDList *list, Coords coords, AVLNode *stations, double distance);
-void AVLFree(AVL *tree, void(*fp)(AVLKey key, AVLValue value));
+int AVLRank(AVL *tree, AVLKey key);
+AVLNode *AVLSelect(AVL *tree, int k);
+void AVLIteratorInit(AVLIterator *iter, AVLNode *root, AVLOrder order);
+AVLNode *AVLIteratorNext(AVLIterator *iter);
+int AVLTraverse(AVLNode *root, AVLOrder order, int(*visit)(AVLNode *node, void *arg), void *arg);
+char *AVLBuildStationsTree(StationTree *tree, char *StationsFileName);
+void AVLBuildTripsTree(TripTable *trips, BikeTree *bikes, StationTree *stations, RouteMatrix *routes,
+	TripList *bikeTrips, char *TripsFileName, int threads);
+void AVLAppendTrips(TripTable *trips, BikeTree *bikes, StationTree *stations, RouteMatrix *routes,
+	TripList *bikeTrips, TripList *byTime, IDTable **bikeTable, IDTable **stationTable,
+	const char *data, size_t size, AppendStats *stats);
+void AVLCountTrips(IDList *sources, IDList *destinations, TripTable *trips, int *count);
+void AVLBuildTimeIndex(TripTable *trips, TripList *byTime);
+int AVLTimeIndexFirst(TripTable *trips, TripList *byTime, long long time);
+void AVLDestroy(AVL *tree, void(*fp)(AVLKey key, void *value));
+
+
+//
+// AVLInOrderNext:
+//
+// Returns the next node of an in-order traversal (see AVLIteratorInit),
+// NULL when it is done: pops the node, then pushes the left spine of
+// its right sub-tree.  The in-order walks call this rather than
+// AVLIteratorNext; it is here so they can inline it, each step is then
+// this loop and nothing else.
+//
+#ifdef _MSC_VER
+#define AVL_INLINE static __inline
+#else
+#define AVL_INLINE static inline
+#endif
+
+AVL_INLINE AVLNode *AVLInOrderNext(AVLIterator *iter)
+{
+	AVLNode *node;
+	AVLNode *cur;
+
+	if (iter->Top < 0)
+		return NULL;
+
+	node = iter->Stack[iter->Top--];
+	for (cur = node->Right; cur != NULL; cur = cur->Left)
+		iter->Stack[++iter->Top] = cur;
+
+	return node;
+}
@@ -0,0 +1,23 @@
+/*avltyped.c*/
+
+//
+// Typed AVL trees, implementation file: expands the functions of
+// StationTree and BikeTree, see avltyped.h.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "avl.h"
+
+
+AVL_TYPED_TREE_DEFINE(Station, STATION)
+AVL_TYPED_TREE_DEFINE(Bike, BIKE)
+AVL_TYPED_INSERT_DEFINE(Bike, BIKE)
@@ -0,0 +1,77 @@
+/*avltyped.h*/
+
+//
+// Typed AVL trees, header file.
+//
+// AVL_TYPED_TREE_DECLARE / AVL_TYPED_TREE_DEFINE generate a tree type
+// and its functions for one value type.  Each tree type is a struct of
+// its own around an AVL tree, so passing a BikeTree where a StationTree
+// is expected doesn't compile; its nodes hold a ValueType each, right
+// after the node (see AVLNode), so a node costs sizeof(AVLNode) +
+// sizeof(ValueType) bytes, and the typed functions hand out ValueType
+// pointers instead of void ones.  Every AVL function -- search, rank,
+// versions, ... -- works on &tree->Base.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+
+//
+// declares Name##Tree and its API, after the AVL types (see avl.h):
+//   Name##TreeCreate()                    empty tree
+//   Name##TreeSearch(tree, key)           pointer to the value, NULL if not found
+//   Name##Value(node)                     pointer to the value of a node of the tree
+//   Name##TreeFree(tree)                  frees the tree, the values own no memory
+//
+#define AVL_TYPED_TREE_DECLARE(Name, ValueType)									\
+	typedef struct Name##Tree													\
+	{																			\
+		AVL Base;																\
+	} Name##Tree;																\
+																				\
+	Name##Tree *Name##TreeCreate();												\
+	ValueType *Name##TreeSearch(Name##Tree *tree, AVLKey key);					\
+	ValueType *Name##Value(AVLNode *node);										\
+	void Name##TreeFree(Name##Tree *tree);
+
+//
+// defines the functions declared above, in exactly one .c file
+//
+#define AVL_TYPED_TREE_DEFINE(Name, ValueType)									\
+	Name##Tree *Name##TreeCreate() {											\
+		Name##Tree *tree = (Name##Tree*)malloc(sizeof(Name##Tree));				\
+		AVLInit(&tree->Base, sizeof(ValueType));								\
+		return tree;															\
+	}																			\
+																				\
+	ValueType *Name##TreeSearch(Name##Tree *tree, AVLKey key) {				\
+		AVLNode *node = AVLSearch(&tree->Base, key);							\
+		return (node == NULL) ? NULL : (ValueType*)AVL_NODE_VALUE(node);		\
+	}																			\
+																				\
+	ValueType *Name##Value(AVLNode *node) {										\
+		return (ValueType*)AVL_NODE_VALUE(node);								\
+	}																			\
+																				\
+	void Name##TreeFree(Name##Tree *tree) {										\
+		AVLDestroy(&tree->Base, NULL);											\
+		free(tree);																\
+	}
+
+//
+// Name##TreeInsert(tree, key, value): TRUE if inserted, FALSE if the
+// key is already there -- for trees filled one key at a time, the
+// others are bulk loaded (see AVLBulkLoad)
+//
+#define AVL_TYPED_INSERT_DECLARE(Name, ValueType)								\
+	int Name##TreeInsert(Name##Tree *tree, AVLKey key, const ValueType *value);
+
+#define AVL_TYPED_INSERT_DEFINE(Name, ValueType)								\
+	int Name##TreeInsert(Name##Tree *tree, AVLKey key, const ValueType *value) {	\
+		return AVLInsert(&tree->Base, key, value);								\
+	}
@@ -0,0 +1,1086 @@
+/*bench.c*/
+
+//
+// Synthetic data generator and benchmarks, implementation file.
+//
+// BenchGenerate writes a stations and a trips CSV file in the Divvy
+// format, of any size, from a seed: the stations are clustered around
+// Chicago neighborhoods, trips mostly stay in the cluster they start
+// in and some stations are much busier than others.  The same seed
+// always gives the same files.
+//
+// BenchRun loads a pair of files phase by phase, then runs each
+// lookup over random inputs for at least BENCH_MIN_SECONDS, and
+// reports ns/op, ops/s and the peak memory of the process so far
+// after every phase.
+//
+// BenchStress inserts into an AVL tree on one thread while others
+// read it, and checks every read.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "bench.h"
+#include "snapshot.h"
+#include "thread.h"
+#include "timer.h"
+
+
+// ----------------------------------------------------------------------------
+// Generator
+// ----------------------------------------------------------------------------
+
+// a neighborhood stations are clustered around
+typedef struct BenchCluster
+{
+	double		Latitude;
+	double		Longtitude;
+	double		Spread;		// std. deviation, degrees
+	double		Weight;		// share of the stations
+
+} BenchCluster;
+
+static const BenchCluster _BenchClusters[] = {
+	{ 41.8819, -87.6278, 0.010, 0.30 },		// Loop
+	{ 41.9214, -87.6513, 0.012, 0.14 },		// Lincoln Park
+	{ 41.9436, -87.6543, 0.012, 0.10 },		// Lakeview
+	{ 41.9088, -87.6796, 0.012, 0.10 },		// Wicker Park
+	{ 41.9231, -87.7093, 0.014, 0.06 },		// Logan Square
+	{ 41.9665, -87.6533, 0.012, 0.06 },		// Uptown
+	{ 41.8564, -87.6600, 0.012, 0.05 },		// Pilsen
+	{ 41.7943, -87.5907, 0.012, 0.05 },		// Hyde Park
+};
+
+#define BENCH_CLUSTERS		((int)(sizeof(_BenchClusters) / sizeof(_BenchClusters[0])))
+#define BENCH_BACKGROUND	0.14		// share of the stations anywhere in the city
+#define BENCH_SAME_CLUSTER	0.65		// share of trips ending in their start cluster
+
+static const char *_BenchStreetsNS[] = {
+	"State St", "Clark St", "Halsted St", "Ashland Ave", "Damen Ave", "Western Ave",
+	"Wells St", "Wabash Ave", "Racine Ave", "Sheffield Ave", "Southport Ave", "Kedzie Ave",
+	"Milwaukee Ave", "Broadway", "Lincoln Ave", "Clybourn Ave"
+};
+
+static const char *_BenchStreetsEW[] = {
+	"Lake St", "Madison St", "Randolph St", "Division St", "North Ave", "Armitage Ave",
+	"Fullerton Ave", "Diversey Pkwy", "Belmont Ave", "Addison St", "Irving Park Rd",
+	"Lawrence Ave", "Roosevelt Rd", "Cermak Rd", "18th St", "Chicago Ave"
+};
+
+#define BENCH_COUNT(a)	((int)(sizeof(a) / sizeof(a[0])))
+
+
+//
+// next pseudo-random 64-bit number of the sequence, splitmix64
+//
+static unsigned long long _BenchRandom(unsigned long long *state) {
+
+	unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+// uniform in [0, 1)
+static double _BenchUniform(unsigned long long *state) {
+
+	return (double)(_BenchRandom(state) >> 11) / 9007199254740992.0;
+}
+
+// uniform in [0, n)
+static int _BenchBelow(unsigned long long *state, int n) {
+
+	return (int)(_BenchUniform(state) * n);
+}
+
+// standard normal, Box-Muller
+static double _BenchGaussian(unsigned long long *state) {
+
+	double u1 = 1.0 - _BenchUniform(state);		// (0, 1]
+	double u2 = _BenchUniform(state);
+
+	return sqrt(-2.0 * log(u1)) * cos(2.0 * 3.14159265358979323846 * u2);
+}
+
+
+//
+// the date of a day since 1970-01-01, inverse of _CSVDaysFromCivil
+//
+static void _BenchCivilFromDays(long long days, int *year, int *month, int *day) {
+
+	long long z = days + 719468;
+	long long era = (z >= 0 ? z : z - 146096) / 146097;
+	long long doe = z - era * 146097;
+	long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	long long mp = (5 * doy + 2) / 153;
+
+	*day = (int)(doy - (153 * mp + 2) / 5 + 1);
+	*month = (int)(mp < 10 ? mp + 3 : mp - 9);
+	*year = (int)(yoe + era * 400 + (*month <= 2));
+}
+
+
+//
+// writes seconds since 1970-01-01 as M/D/YYYY H:MM, like the Divvy files
+//
+static void _BenchWriteTime(FILE *out, long long time) {
+
+	int year, month, day;
+
+	_BenchCivilFromDays(time / 86400, &year, &month, &day);
+	fprintf(out, "%d/%d/%d %d:%02d", month, day, year,
+		(int)(time % 86400 / 3600), (int)(time % 3600 / 60));
+}
+
+
+//
+// index of the first entry of cumulative[0, count) above u
+//
+static int _BenchPick(const double *cumulative, int count, double u) {
+
+	int lo = 0, hi = count - 1;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (cumulative[mid] > u)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+
+//
+// BenchGenerate:
+//
+// Writes stationCount stations and tripCount trips, generated from
+// the seed, to the two files.  Returns TRUE if successful.
+//
+int BenchGenerate(char *StationsFileName, char *TripsFileName, int stationCount,
+	long long tripCount, unsigned long long seed) {
+
+	unsigned long long state = seed;
+	double start = TimerNow();
+	int i, c;
+	long long t;
+
+	if (stationCount < 1 || tripCount < 0 || tripCount > 500000000)
+		return FALSE;
+
+	FILE *stationsFile = fopen(StationsFileName, "w");
+	if (stationsFile == NULL)
+		return FALSE;
+
+	FILE *tripsFile = fopen(TripsFileName, "w");
+	if (tripsFile == NULL) {
+		fclose(stationsFile);
+		return FALSE;
+	}
+
+	setvbuf(stationsFile, NULL, _IOFBF, 1 << 20);
+	setvbuf(tripsFile, NULL, _IOFBF, 1 << 20);
+
+	int *cluster = (int*)malloc(sizeof(int) * stationCount);		// of each station
+	char **names = (char**)malloc(sizeof(char*) * stationCount);
+	double *popularity = (double*)malloc(sizeof(double) * stationCount);
+	int *byCluster = (int*)malloc(sizeof(int) * stationCount);		// stations, by cluster
+	int clusterFirst[BENCH_CLUSTERS + 2];
+
+	//
+	// stations: a cluster each (or none, BENCH_CLUSTERS), a spot near it,
+	// a name from the streets, and a Zipf-like popularity
+	//
+	fprintf(stationsFile, "id,name,latitude,longitude,dpcapacity,online_date\n");
+
+	double clusterWeights[BENCH_CLUSTERS];
+	double total = BENCH_BACKGROUND;
+	for (c = 0; c < BENCH_CLUSTERS; c++)
+		total += _BenchClusters[c].Weight;
+	for (c = 0; c < BENCH_CLUSTERS; c++)
+		clusterWeights[c] = ((c > 0) ? clusterWeights[c - 1] : 0) + _BenchClusters[c].Weight / total;
+
+	for (i = 0; i < stationCount; i++) {
+		double latitude, longtitude;
+		double u = _BenchUniform(&state);
+		char name[128];
+		int year, month, day;
+
+		// past the last cluster's share => background
+		c = _BenchPick(clusterWeights, BENCH_CLUSTERS, u);
+		if (u >= clusterWeights[BENCH_CLUSTERS - 1])
+			c = BENCH_CLUSTERS;
+
+		if (c == BENCH_CLUSTERS) {
+			latitude = 41.73 + 0.33 * _BenchUniform(&state);
+			longtitude = -87.80 + 0.25 * _BenchUniform(&state);
+		}
+		else {
+			latitude = _BenchClusters[c].Latitude + _BenchClusters[c].Spread * _BenchGaussian(&state);
+			longtitude = _BenchClusters[c].Longtitude + _BenchClusters[c].Spread * _BenchGaussian(&state);
+		}
+
+		sprintf(name, "%s & %s", _BenchStreetsNS[_BenchBelow(&state, BENCH_COUNT(_BenchStreetsNS))],
+			_BenchStreetsEW[_BenchBelow(&state, BENCH_COUNT(_BenchStreetsEW))]);
+		names[i] = (char*)malloc(strlen(name) + 1);
+		strcpy(names[i], name);
+		cluster[i] = c;
+
+		_BenchCivilFromDays(15706 + _BenchBelow(&state, 4 * 365), &year, &month, &day);
+		fprintf(stationsFile, "%d,%s,%.8f,%.8f,%d,%d/%d/%d\n", i + 1, name, latitude, longtitude,
+			11 + _BenchBelow(&state, 35), month, day, year);
+	}
+
+	//
+	// Zipf-like popularity: the stations in a random order -- shuffled
+	// in byCluster, before it's used for the groups -- and the one of
+	// rank r gets 1 / (r + 1)
+	//
+	for (i = 0; i < stationCount; i++)
+		byCluster[i] = i;
+	for (i = stationCount - 1; i > 0; i--) {
+		int j = _BenchBelow(&state, i + 1);
+		int swap = byCluster[i];
+		byCluster[i] = byCluster[j];
+		byCluster[j] = swap;
+	}
+	for (i = 0; i < stationCount; i++)
+		popularity[byCluster[i]] = 1.0 / (1 + i);
+
+	// popularity => cumulative share
+	total = 0;
+	for (i = 0; i < stationCount; i++)
+		total += popularity[i];
+	for (i = 0; i < stationCount; i++)
+		popularity[i] = ((i > 0) ? popularity[i - 1] : 0) + popularity[i] / total;
+
+	// group the stations by cluster
+	memset(clusterFirst, 0, sizeof(clusterFirst));
+	for (i = 0; i < stationCount; i++)
+		clusterFirst[cluster[i] + 1]++;
+	for (c = 0; c <= BENCH_CLUSTERS; c++)
+		clusterFirst[c + 1] += clusterFirst[c];
+	int clusterNext[BENCH_CLUSTERS + 1];
+	memcpy(clusterNext, clusterFirst, sizeof(clusterNext));
+	for (i = 0; i < stationCount; i++)
+		byCluster[clusterNext[cluster[i]]++] = i;
+
+	//
+	// trips: ascending ids and start times over 2016, a popular start
+	// station, and an end in the same cluster or anywhere
+	//
+	fprintf(tripsFile, "trip_id,starttime,stoptime,bikeid,tripduration,from_station_id,"
+		"from_station_name,to_station_id,to_station_name,usertype,gender,birthyear\n");
+
+	int bikeCount = (int)(tripCount / 100);
+	if (bikeCount < 10)
+		bikeCount = 10;
+	if (bikeCount > 6000)
+		bikeCount = 6000;
+
+	int tripID = 10000000;
+	double time = 16801.0 * 86400;			// 1/1/2016 0:00
+	double step = (tripCount > 0) ? 366.0 * 86400 / tripCount : 0;
+
+	for (t = 0; t < tripCount; t++) {
+		int from = _BenchPick(popularity, stationCount, _BenchUniform(&state));
+		int to;
+		int duration = 60 + (int)(-log(1.0 - _BenchUniform(&state)) * 840);
+		long long startTime = (long long)time;
+
+		if (duration > 86400)
+			duration = 86400;
+
+		c = cluster[from];
+		if (_BenchUniform(&state) < BENCH_SAME_CLUSTER)
+			to = byCluster[clusterFirst[c] + _BenchBelow(&state, clusterFirst[c + 1] - clusterFirst[c])];
+		else
+			to = _BenchPick(popularity, stationCount, _BenchUniform(&state));
+
+		fprintf(tripsFile, "%d,", tripID);
+		_BenchWriteTime(tripsFile, startTime);
+		fputc(',', tripsFile);
+		_BenchWriteTime(tripsFile, startTime + duration);
+		fprintf(tripsFile, ",%d,%d,%d,%s,%d,%s,", 1 + _BenchBelow(&state, bikeCount), duration,
+			from + 1, names[from], to + 1, names[to]);
+
+		if (_BenchUniform(&state) < 0.85)
+			fprintf(tripsFile, "Subscriber,%s,%d\n",
+				(_BenchUniform(&state) < 0.7) ? "Male" : "Female", 1950 + _BenchBelow(&state, 50));
+		else
+			fprintf(tripsFile, "Customer,,\n");
+
+		tripID += 1 + _BenchBelow(&state, 2);
+		time += step * 2 * _BenchUniform(&state);
+	}
+
+	int ok = (ferror(stationsFile) == 0) && (ferror(tripsFile) == 0);
+	ok = (fclose(stationsFile) == 0) && ok;
+	ok = (fclose(tripsFile) == 0) && ok;
+
+	fprintf(stderr, "** Generated '%s': %d stations, '%s': %lld trips in %.3f secs (seed %llu)\n",
+		StationsFileName, stationCount, TripsFileName, tripCount, TimerNow() - start, seed);
+
+	for (i = 0; i < stationCount; i++)
+		free(names[i]);
+	free(names);
+	free(cluster);
+	free(popularity);
+	free(byCluster);
+
+	return ok;
+}
+
+
+// ----------------------------------------------------------------------------
+// Benchmarks
+// ----------------------------------------------------------------------------
+
+// random inputs of the microbenchmarks
+typedef struct BenchContext
+{
+	DivvyData	*Data;
+	AVLKey		*StationIDs;		// BENCH_QUERIES of each
+	AVLKey		*TripIDs;
+	AVLKey		*BikeIDs;
+	Coords		*Points;
+	IDList		*Sources[BENCH_ROUTES];
+	IDList		*Destinations[BENCH_ROUTES];
+	long long	From[BENCH_ROUTES];		// time windows
+	long long	To[BENCH_ROUTES];
+	long long	Sink;				// results, so nothing is optimized away
+
+} BenchContext;
+
+
+//
+// peak memory of the process so far, in MB
+//
+static double _BenchPeakMB() {
+
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / (1024.0 * 1024.0);		// bytes
+#else
+	return usage.ru_maxrss / 1024.0;				// KB
+#endif
+#endif
+}
+
+
+//
+// prints a line of the report
+//
+static void _BenchReport(const char *phase, long long ops, double seconds) {
+
+	printf("   %-22s %11lld %9.3f %12.1f %12.0f %9.1f\n", phase, ops, seconds,
+		ops > 0 ? seconds * 1e9 / ops : 0.0, ops / (seconds > 0 ? seconds : 1e-9), _BenchPeakMB());
+	fflush(stdout);
+}
+
+
+//
+// runs op on inputs 0, 1, 2, ... in batches of 1, 2, 4, ... until it
+// has taken BENCH_MIN_SECONDS, and reports the average
+//
+static void _BenchMeasure(BenchContext *ctx, const char *phase, void(*op)(BenchContext *ctx, int i)) {
+
+	long long ops = 0;
+	long long batch = 1;
+	long long i;
+	double start = TimerNow();
+	double seconds;
+
+	do {
+		for (i = 0; i < batch; i++)
+			op(ctx, (int)((ops + i) & (BENCH_QUERIES - 1)));
+		ops += batch;
+		batch *= 2;
+		seconds = TimerNow() - start;
+	} while (seconds < BENCH_MIN_SECONDS);
+
+	_BenchReport(phase, ops, seconds);
+}
+
+
+//
+// the microbenchmarks, one operation on input i each
+//
+static void _BenchStationAVL(BenchContext *ctx, int i) {
+
+	ctx->Sink += AVLSearch(&ctx->Data->Stations->Base, ctx->StationIDs[i]) != NULL;
+}
+
+static void _BenchStationTable(BenchContext *ctx, int i) {
+
+	ctx->Sink += IDTableSearch(ctx->Data->StationTable, &ctx->Data->Stations->Base, ctx->StationIDs[i]) != NULL;
+}
+
+static void _BenchBikeAVL(BenchContext *ctx, int i) {
+
+	ctx->Sink += AVLSearch(&ctx->Data->Bikes->Base, ctx->BikeIDs[i]) != NULL;
+}
+
+static void _BenchBikeTable(BenchContext *ctx, int i) {
+
+	ctx->Sink += IDTableSearch(ctx->Data->BikeTable, &ctx->Data->Bikes->Base, ctx->BikeIDs[i]) != NULL;
+}
+
+static void _BenchTrip(BenchContext *ctx, int i) {
+
+	ctx->Sink += TripTableFind(ctx->Data->Trips, ctx->TripIDs[i]);
+}
+
+//
+// in-order walks of the whole bikes tree, one per op: recursive, the
+// way the traversals were written before AVLIterator, and with it
+//
+static long long _BenchWalkRecursive(AVLNode *node) {
+
+	if (node == NULL)
+		return 0;
+
+	return _BenchWalkRecursive(node->Left) + node->Key + _BenchWalkRecursive(node->Right);
+}
+
+static void _BenchWalkRecursiveOp(BenchContext *ctx, int i) {
+
+	ctx->Sink += _BenchWalkRecursive(ctx->Data->Bikes->Base.Root) + i;
+}
+
+static void _BenchWalkIterator(BenchContext *ctx, int i) {
+
+	AVLIterator iter;
+	AVLNode *node;
+	long long sum = 0;		// in a local, as the recursive walk does
+
+	AVLIteratorInit(&iter, ctx->Data->Bikes->Base.Root, AVLInOrder);
+	while ((node = AVLInOrderNext(&iter)) != NULL)
+		sum += node->Key;
+	ctx->Sink += sum + i;
+}
+
+static void _BenchFindBrute(BenchContext *ctx, int i) {
+
+	ClosestStations closestStations;
+
+	InitializeClosestStations(&closestStations);
+	AVLFindClosestStations(ctx->Data->Stations->Base.Root, ctx->Points[i], BENCH_DISTANCE, &closestStations);
+	SortClosestStations(&closestStations);
+	ctx->Sink += closestStations.count;
+	free(closestStations.stations);
+}
+
+static void _BenchFindKD(BenchContext *ctx, int i) {
+
+	ClosestStations closestStations;
+
+	InitializeClosestStations(&closestStations);
+	KDFindClosestStations(ctx->Data->StationIndex, ctx->Points[i], BENCH_DISTANCE, &closestStations);
+	SortClosestStations(&closestStations);
+	ctx->Sink += closestStations.count;
+	free(closestStations.stations);
+}
+
+static void _BenchRouteScan(BenchContext *ctx, int i) {
+
+	int count = 0;
+
+	i &= BENCH_ROUTES - 1;
+	AVLCountTrips(ctx->Sources[i], ctx->Destinations[i], ctx->Data->Trips, &count);
+	ctx->Sink += count;
+}
+
+static void _BenchRouteMatrix(BenchContext *ctx, int i) {
+
+	i &= BENCH_ROUTES - 1;
+	ctx->Sink += RouteMatrixCountTrips(ctx->Data->Routes, ctx->Sources[i], ctx->Destinations[i]);
+}
+
+static void _BenchRouteWindow(BenchContext *ctx, int i) {
+
+	int windowTrips = 0;
+
+	i &= BENCH_ROUTES - 1;
+	ctx->Sink += CountRouteTrips(ctx->Data->Trips, &ctx->Data->TripsByTime, ctx->From[i],
+		ctx->To[i], ctx->Sources[i], ctx->Destinations[i], &windowTrips);
+}
+
+
+//
+// draws the random inputs: existing ids, points near stations, and
+// the station sets around both ends of random trips
+//
+static void _BenchInputs(BenchContext *ctx) {
+
+	DivvyData *data = ctx->Data;
+	TripTable *trips = data->Trips;
+	unsigned long long state = 12345;
+	int stationCount = 0, bikeCount = 0;
+	int i;
+
+	AVLKey *stationKeys = (AVLKey*)malloc(sizeof(AVLKey) * (AVLCount(&data->Stations->Base) + 1));
+	AVLKey *bikeKeys = (AVLKey*)malloc(sizeof(AVLKey) * (AVLCount(&data->Bikes->Base) + 1));
+	CollectKeys(data->Stations->Base.Root, stationKeys, &stationCount);
+	CollectKeys(data->Bikes->Base.Root, bikeKeys, &bikeCount);
+
+	ctx->StationIDs = (AVLKey*)malloc(sizeof(AVLKey) * BENCH_QUERIES);
+	ctx->TripIDs = (AVLKey*)malloc(sizeof(AVLKey) * BENCH_QUERIES);
+	ctx->BikeIDs = (AVLKey*)malloc(sizeof(AVLKey) * BENCH_QUERIES);
+	ctx->Points = (Coords*)malloc(sizeof(Coords) * BENCH_QUERIES);
+
+	for (i = 0; i < BENCH_QUERIES; i++) {
+		AVLKey id = stationKeys[_BenchBelow(&state, stationCount)];
+		Coords near = StationTreeSearch(data->Stations, id)->Coordinates;
+
+		ctx->StationIDs[i] = id;
+		ctx->TripIDs[i] = trips->Count > 0 ? trips->TripID[_BenchBelow(&state, trips->Count)] : 0;
+		ctx->BikeIDs[i] = bikeCount > 0 ? bikeKeys[_BenchBelow(&state, bikeCount)] : 0;
+
+		// a few blocks from a station
+		ctx->Points[i].latitude = near.latitude + 0.005 * _BenchGaussian(&state);
+		ctx->Points[i].longtitude = near.longtitude + 0.005 * _BenchGaussian(&state);
+	}
+
+	for (i = 0; i < BENCH_ROUTES; i++) {
+		int row = trips->Count > 0 ? _BenchBelow(&state, trips->Count) : -1;
+
+		ctx->Sources[i] = InitializeIDList();
+		ctx->Destinations[i] = InitializeIDList();
+		ctx->From[i] = 0;
+		ctx->To[i] = 0;
+		if (row < 0)
+			continue;
+
+		AVLNode *source = IDTableSearch(data->StationTable, &data->Stations->Base, trips->FromID[row]);
+		AVLNode *dest = IDTableSearch(data->StationTable, &data->Stations->Base, trips->ToID[row]);
+		if (source != NULL)
+			KDBuildSubSet(data->StationIndex, ctx->Sources[i], StationValue(source)->Coordinates,
+				BENCH_DISTANCE);
+		if (dest != NULL)
+			KDBuildSubSet(data->StationIndex, ctx->Destinations[i], StationValue(dest)->Coordinates,
+				BENCH_DISTANCE);
+
+		// the days before the trip
+		ctx->To[i] = trips->StartTime[row] + 1;
+		ctx->From[i] = ctx->To[i] - BENCH_WINDOW_DAYS * 24 * 60 * 60;
+	}
+
+	free(stationKeys);
+	free(bikeKeys);
+}
+
+
+//
+// BenchRun:
+//
+// Loads the CSV files and runs the benchmarks, writing the report to
+// stdout.  Snapshots are not read, but if saveSnapshot, one is written
+// next to the trips file and read back to time it.  Returns TRUE if
+// successful.
+//
+int BenchRun(char *StationsFileName, char *TripsFileName, int threads, int saveSnapshot) {
+
+	DivvyData data;
+	BenchContext ctx;
+	double start;
+	double loadSeconds = 0;		// CSV load, as recorded in the snapshot
+	int i;
+
+	printf("** Benchmark: '%s', '%s', %d threads\n", StationsFileName, TripsFileName, threads);
+	printf("   %-22s %11s %9s %12s %12s %9s\n", "phase", "ops", "secs", "ns/op", "ops/s", "peak MB");
+	_BenchReport("start", 0, 0);
+
+	//
+	// loading, one op per row
+	//
+	data.Stations = StationTreeCreate();
+	data.Trips = TripTableCreate();
+	data.Bikes = BikeTreeCreate();
+	data.Routes = RouteMatrixCreate();
+
+	start = TimerNow();
+	char *stationNames = AVLBuildStationsTree(data.Stations, StationsFileName);
+	loadSeconds += TimerNow() - start;
+	_BenchReport("load stations", AVLCount(&data.Stations->Base), TimerNow() - start);
+
+	if (AVLCount(&data.Stations->Base) == 0) {
+		printf("**Error: no stations in '%s'\n\n", StationsFileName);
+		StationTreeFree(data.Stations);
+		TripTableFree(data.Trips);
+		BikeTreeFree(data.Bikes);
+		RouteMatrixFree(data.Routes);
+		free(stationNames);
+		return FALSE;
+	}
+
+	start = TimerNow();
+	AVLBuildTripsTree(data.Trips, data.Bikes, data.Stations, data.Routes, &data.BikeTrips,
+		TripsFileName, threads);
+	loadSeconds += TimerNow() - start;
+	_BenchReport("load trips", TripTableCount(data.Trips), TimerNow() - start);
+
+	start = TimerNow();
+	AVLBuildTimeIndex(data.Trips, &data.TripsByTime);
+	loadSeconds += TimerNow() - start;
+	_BenchReport("time index", TripTableCount(data.Trips), TimerNow() - start);
+
+	start = TimerNow();
+	data.StationIndex = KDBuild(data.Stations);
+	data.StationTable = IDTableBuild(&data.Stations->Base);
+	data.BikeTable = IDTableBuild(&data.Bikes->Base);
+	data.Files = NULL;
+	_BenchReport("k-d tree, ID tables", AVLCount(&data.Stations->Base) + AVLCount(&data.Bikes->Base),
+		TimerNow() - start);
+
+	//
+	// lookups
+	//
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.Data = &data;
+	_BenchInputs(&ctx);
+
+	_BenchMeasure(&ctx, "station AVLSearch", _BenchStationAVL);
+	_BenchMeasure(&ctx, "station IDTable", _BenchStationTable);
+	_BenchMeasure(&ctx, "bike AVLSearch", _BenchBikeAVL);
+	_BenchMeasure(&ctx, "bike IDTable", _BenchBikeTable);
+	_BenchMeasure(&ctx, "trip TripTableFind", _BenchTrip);
+	_BenchMeasure(&ctx, "bikes walk recursive", _BenchWalkRecursiveOp);
+	_BenchMeasure(&ctx, "bikes walk iterator", _BenchWalkIterator);
+	_BenchMeasure(&ctx, "find brute force", _BenchFindBrute);
+	_BenchMeasure(&ctx, "find k-d tree", _BenchFindKD);
+	_BenchMeasure(&ctx, "route scan", _BenchRouteScan);
+	_BenchMeasure(&ctx, "route matrix", _BenchRouteMatrix);
+	_BenchMeasure(&ctx, "route 30-day window", _BenchRouteWindow);
+
+	//
+	// snapshot round trip, one op per trip, if asked for:
+	//
+	char *snapshotFileName = (char*)malloc(strlen(TripsFileName) + strlen(SNAPSHOT_SUFFIX) + 1);
+	strcpy(snapshotFileName, TripsFileName);
+	strcat(snapshotFileName, SNAPSHOT_SUFFIX);
+
+	start = TimerNow();
+	if (saveSnapshot && SnapshotSave(snapshotFileName, StationsFileName, TripsFileName, data.Stations, data.Trips,
+		data.Bikes, data.Routes, &data.BikeTrips, &data.TripsByTime, stationNames, loadSeconds)) {
+		_BenchReport("snapshot save", TripTableCount(data.Trips), TimerNow() - start);
+
+		DivvyData copy;
+		char *copyNames = NULL;
+		copy.Stations = StationTreeCreate();
+		copy.Trips = TripTableCreate();
+		copy.Bikes = BikeTreeCreate();
+		copy.Routes = RouteMatrixCreate();
+
+		start = TimerNow();
+		if (SnapshotLoad(snapshotFileName, StationsFileName, TripsFileName, copy.Stations,
+			copy.Trips, copy.Bikes, copy.Routes, &copy.BikeTrips, &copy.TripsByTime, &copyNames)) {
+			_BenchReport("snapshot load", TripTableCount(copy.Trips), TimerNow() - start);
+			free(copy.BikeTrips.Rows);
+			free(copy.TripsByTime.Rows);
+		}
+
+		StationTreeFree(copy.Stations);
+		TripTableFree(copy.Trips);
+		BikeTreeFree(copy.Bikes);
+		RouteMatrixFree(copy.Routes);
+		free(copyNames);
+	}
+
+	printf("** Checksum: %lld\n", ctx.Sink);
+
+	//
+	// free everything
+	//
+	for (i = 0; i < BENCH_ROUTES; i++) {
+		FreeIDList(ctx.Sources[i]);
+		FreeIDList(ctx.Destinations[i]);
+	}
+	free(ctx.StationIDs);
+	free(ctx.TripIDs);
+	free(ctx.BikeIDs);
+	free(ctx.Points);
+
+	StationTreeFree(data.Stations);
+	TripTableFree(data.Trips);
+	BikeTreeFree(data.Bikes);
+	KDFree(data.StationIndex);
+	IDTableFree(data.StationTable);
+	IDTableFree(data.BikeTable);
+	RouteMatrixFree(data.Routes);
+	free(data.BikeTrips.Rows);
+	free(data.TripsByTime.Rows);
+	free(stationNames);
+	free(snapshotFileName);
+
+	return TRUE;
+}
+
+
+// ----------------------------------------------------------------------------
+// Stress test of the AVL read path
+// ----------------------------------------------------------------------------
+
+#ifdef _MSC_VER
+#define BENCH_LOAD(x)		InterlockedCompareExchange((volatile LONG*)&(x), 0, 0)
+#define BENCH_STORE(x, v)	InterlockedExchange((volatile LONG*)&(x), (v))
+#else
+#define BENCH_LOAD(x)		__atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define BENCH_STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#endif
+
+// shared by the writer and the readers
+typedef struct StressShared
+{
+	BikeTree	*Tree;
+	AVLKey		*Order;			// keys in insertion order, all odd
+	int			Count;
+	int			Inserted;		// Order[0, Inserted) are in the tree
+	int			Done;			// TRUE once the writer is done
+
+} StressShared;
+
+// one reader thread
+typedef struct StressReader
+{
+	StressShared	*Shared;
+	unsigned long long Seed;
+	long long		Searches;
+	long long		Walks;
+	long long		Errors;
+	AVLVersion		*Version;		// held since the last walk, NULL => none
+	long long		VersionSum;		// what the walk of it saw
+
+} StressReader;
+
+
+//
+// the value stored with a key, so a reader can tell a node that was
+// reused under it
+//
+static int _BenchStressValue(AVLKey key) {
+
+	return (int)((unsigned int)key * 2654435761u);
+}
+
+
+//
+// walks the version of the tree at root in order, checking it is a
+// valid AVL tree of between lo and hi nodes, and sums up its keys and
+// values into *sum; returns # of errors
+//
+static int _BenchStressWalk(AVLNode *root, int lo, int hi, long long *sum) {
+
+	AVLIterator iter;
+	AVLNode *node;
+	AVLNode *last = NULL;
+	int count = 0;
+	int errors = 0;
+
+	*sum = 0;
+
+	AVLIteratorInit(&iter, root, AVLInOrder);
+	while ((node = AVLInOrderNext(&iter)) != NULL) {
+		int hl = (node->Left == NULL) ? -1 : node->Left->Height;
+		int hr = (node->Right == NULL) ? -1 : node->Right->Height;
+		int sl = (node->Left == NULL) ? 0 : node->Left->Size;
+		int sr = (node->Right == NULL) ? 0 : node->Right->Size;
+
+		if ((last != NULL && last->Key >= node->Key)
+			|| node->Height != 1 + (hl > hr ? hl : hr) || hl - hr > 1 || hr - hl > 1
+			|| node->Size != 1 + sl + sr
+			|| BikeValue(node)->TripCount != _BenchStressValue(node->Key))
+			errors++;
+
+		*sum += (long long)node->Key * 31 + BikeValue(node)->TripCount;
+		last = node;
+		count++;
+	}
+
+	if (count < lo || count > hi || count != ((root == NULL) ? 0 : root->Size))
+		errors++;
+
+	return errors;
+}
+
+
+//
+// walks the version the reader holds again -- inserts since must not
+// have changed it -- and releases it
+//
+static void _BenchStressRecheck(StressReader *reader) {
+
+	AVLNode *root = reader->Version->Root;
+	int count = (root == NULL) ? 0 : root->Size;
+	long long sum;
+
+	reader->Errors += _BenchStressWalk(root, count, count, &sum);
+	if (sum != reader->VersionSum)
+		reader->Errors++;
+
+	AVLVersionRelease(reader->Version);
+	reader->Version = NULL;
+}
+
+
+//
+// thread function: searches for random keys, and now and then takes
+// a version of the tree and walks it, until the writer is done; every
+// answer is checked against what must be in the tree at that point
+//
+static void _BenchStressRead(void *arg) {
+
+	StressReader *reader = (StressReader*)arg;
+	StressShared *shared = reader->Shared;
+	unsigned long long state = reader->Seed;
+
+	do {
+		if (reader->Searches % (shared->Count / 16 + 1) == 0) {
+			// every so many searches that walks cost about 16 nodes
+			// per search: the version from last time is unchanged, and
+			// the current one has at least what was in before
+			if (reader->Version != NULL)
+				_BenchStressRecheck(reader);
+
+			int before = BENCH_LOAD(shared->Inserted);
+			reader->Version = AVLVersionTake(&shared->Tree->Base);
+			int after = BENCH_LOAD(shared->Inserted);
+
+			reader->Errors += _BenchStressWalk(reader->Version->Root, before, after + 1,
+				&reader->VersionSum);
+			reader->Walks++;
+		}
+
+		AVLReadBegin();
+		int before = BENCH_LOAD(shared->Inserted);
+
+		int i = _BenchBelow(&state, shared->Count);
+		AVLKey key = shared->Order[i];
+		AVLNode *found = AVLSearch(&shared->Tree->Base, key);
+		AVLNode *absent = AVLSearch(&shared->Tree->Base, key - 1);		// even, never inserted
+		int after = BENCH_LOAD(shared->Inserted);
+
+		// in before the search => found, intact; not started => not found
+		if (i < before && (found == NULL || found->Key != key
+			|| BikeValue(found)->TripCount != _BenchStressValue(key)))
+			reader->Errors++;
+		if (i > after && found != NULL)
+			reader->Errors++;
+		if (absent != NULL)
+			reader->Errors++;
+
+		AVLReadEnd();
+		reader->Searches++;
+	} while (!BENCH_LOAD(shared->Done));
+
+	if (reader->Version != NULL)
+		_BenchStressRecheck(reader);
+}
+
+
+//
+// BenchStress:
+//
+// Checks that AVL trees can be read while they are inserted into, see
+// the read path in avl.c.  One thread inserts count keys in random
+// order while threads - 1 others (at least one) search for random
+// keys and now and then take a version of the tree, walk it, and walk
+// it again at the next one, when it must be the same; each answer is
+// checked against the keys inserted before and after it.  Then the
+// tree is compared with one built serially from the same keys.  The
+// writer holds a version of its own from one recheck to the next,
+// which must keep the nodes the inserts since replaced, see
+// AVLVersionHeld.  The serial tree is neither shared nor held, so it
+// is built in place.  Reports the rates, the memory kept for
+// versions, and any errors on stdout, returns TRUE if there were none.
+//
+int BenchStress(int threads, int count, unsigned long long seed) {
+
+	StressShared shared;
+	BIKE value;
+	AVLChunk *chunk;
+	AVLVersion *mine = NULL;
+	long long searches = 0, walks = 0, errors = 0;
+	long long heldSum = 0, versionSum = 0, samples = 0;
+	long long mineSum = 0, sum;
+	int readers = (threads > 1) ? threads - 1 : 1;
+	int arenaNodes = 0;
+	int versions, held, mostHeld = 0;
+	int mineCount = 0, mineHeld;
+	int i;
+
+	if (count < 1)
+		count = 1;
+
+	printf("** Stress: %d inserts on 1 thread, %d reader threads, seed %llu\n", count,
+		readers, seed);
+
+	// odd keys in random order, the even ones are never inserted
+	shared.Order = (AVLKey*)malloc(sizeof(AVLKey) * count);
+	for (i = 0; i < count; i++)
+		shared.Order[i] = 2 * i + 1;
+	for (i = count - 1; i > 0; i--) {
+		int j = _BenchBelow(&seed, i + 1);
+		AVLKey t = shared.Order[i];
+		shared.Order[i] = shared.Order[j];
+		shared.Order[j] = t;
+	}
+
+	shared.Tree = BikeTreeCreate();
+	AVLShare(&shared.Tree->Base);
+	shared.Count = count;
+	shared.Inserted = 0;
+	shared.Done = FALSE;
+
+	StressReader *work = (StressReader*)calloc(readers, sizeof(StressReader));
+	Thread *workers = (Thread*)malloc(sizeof(Thread) * readers);
+	int *started = (int*)malloc(sizeof(int) * readers);
+
+	for (i = 0; i < readers; i++) {
+		work[i].Shared = &shared;
+		work[i].Seed = _BenchRandom(&seed);
+		started[i] = ThreadStart(&workers[i], _BenchStressRead, &work[i]);
+	}
+
+	//
+	// insert, the readers check along the way
+	//
+	double start = TimerNow();
+
+	value.FirstTrip = 0;
+	value.ListCount = 0;
+	for (i = 0; i < count; i++) {
+		value.TripCount = _BenchStressValue(shared.Order[i]);
+		BikeTreeInsert(shared.Tree, shared.Order[i], &value);
+		BENCH_STORE(shared.Inserted, i + 1);
+
+		// what the versions the readers hold keep
+		if (i % (count / 64 + 1) == 0) {
+			AVLVersionUsage(&shared.Tree->Base, &versions, &held);
+			heldSum += held;
+			versionSum += versions;
+			samples++;
+			if (held > mostHeld)
+				mostHeld = held;
+		}
+
+		// the writer's version: unchanged, and still held if an insert
+		// since replaced any of it
+		if (i % (count / 8 + 1) == 0) {
+			if (mine != NULL) {
+				mineHeld = AVLVersionHeld(&shared.Tree->Base, mine);
+				AVLVersionUsage(&shared.Tree->Base, &versions, &held);
+				errors += _BenchStressWalk(mine->Root, mineCount, mineCount, &sum);
+				if (sum != mineSum || (mine->Root != NULL && mineHeld < 1) || mineHeld > held)
+					errors++;
+				AVLVersionRelease(mine);
+			}
+
+			mine = AVLVersionTake(&shared.Tree->Base);
+			mineCount = i + 1;
+			errors += _BenchStressWalk(mine->Root, mineCount, mineCount, &mineSum);
+		}
+	}
+	BENCH_STORE(shared.Done, TRUE);
+
+	if (mine != NULL)
+		AVLVersionRelease(mine);
+
+	double seconds = TimerNow() - start;
+
+	for (i = 0; i < readers; i++) {
+		if (started[i])
+			ThreadJoin(&workers[i]);
+		else
+			_BenchStressRead(&work[i]);		// no thread, check the end result here
+
+		searches += work[i].Searches;
+		walks += work[i].Walks;
+		errors += work[i].Errors;
+	}
+
+	//
+	// the serial oracle: same keys, same order, one thread
+	//
+	BikeTree *serial = BikeTreeCreate();
+	for (i = 0; i < count; i++) {
+		value.TripCount = _BenchStressValue(shared.Order[i]);
+		BikeTreeInsert(serial, shared.Order[i], &value);
+	}
+
+	AVLIterator iter, serialIter;
+	AVLNode *node, *serialNode;
+	AVLIteratorInit(&iter, AVLRoot(&shared.Tree->Base), AVLPreOrder);
+	AVLIteratorInit(&serialIter, AVLRoot(&serial->Base), AVLPreOrder);
+	do {
+		node = AVLIteratorNext(&iter);
+		serialNode = AVLIteratorNext(&serialIter);
+		if ((node == NULL) != (serialNode == NULL)
+			|| (node != NULL && (node->Key != serialNode->Key || node->Height != serialNode->Height
+			|| BikeValue(node)->TripCount != BikeValue(serialNode)->TripCount)))
+			errors++;
+	} while (node != NULL && serialNode != NULL);
+
+	errors += _BenchStressWalk(AVLRoot(&shared.Tree->Base), count, count, &sum);
+
+	// every version was released
+	AVLVersionUsage(&shared.Tree->Base, &versions, &held);
+	if (versions != 0)
+		errors++;
+
+	for (chunk = shared.Tree->Base.Chunks; chunk != NULL; chunk = chunk->Next)
+		arenaNodes += chunk->Used;
+
+	printf("   inserts: %d in %.3f secs (%.0f/s), %d nodes in the arena, %d retired\n", count,
+		seconds, count / (seconds > 0 ? seconds : 1e-9), arenaNodes, shared.Tree->Base.RetiredCount);
+	printf("   reads:   %lld searches, %lld walks (%.0f searches/s)\n", searches, walks,
+		searches / (seconds > 0 ? seconds : 1e-9));
+	printf("   versions: %.1f held on average, %.1f KB/version kept, %.1f KB at most\n",
+		(double)versionSum / samples, versionSum == 0 ? 0.0 : (double)heldSum * shared.Tree->Base.NodeSize / 1024 / versionSum,
+		(double)mostHeld * shared.Tree->Base.NodeSize / 1024);
+
+	if (errors == 0)
+		printf("** Stress: passed, same tree as the serial one\n");
+	else
+		printf("** Stress: FAILED, %lld wrong answers\n", errors);
+
+	BikeTreeFree(shared.Tree);
+	BikeTreeFree(serial);
+	free(shared.Order);
+	free(work);
+	free(workers);
+	free(started);
+
+	return errors == 0;
+}
@@ -0,0 +1,30 @@
+/*bench.h*/
+
+//
+// Synthetic data generator and benchmarks, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "query.h"
+
+#define BENCH_MIN_SECONDS	0.25		// each microbenchmark runs at least this long
+#define BENCH_QUERIES		(1 << 16)	// distinct random inputs per microbenchmark
+#define BENCH_ROUTES		64			// distinct (sources, destinations) sets
+#define BENCH_DISTANCE		0.5			// miles, for find and route
+#define BENCH_WINDOW_DAYS	30			// time window of "route window"
+
+
+//
+// benchmark API:
+// function prototypes
+//
+int BenchGenerate(char *StationsFileName, char *TripsFileName, int stationCount,
+	long long tripCount, unsigned long long seed);
+int BenchRun(char *StationsFileName, char *TripsFileName, int threads, int saveSnapshot);
+int BenchStress(int threads, int count, unsigned long long seed);
@@ -0,0 +1,283 @@
+/*cavl.c*/
+
+//
+// Compact AVL tree, implementation file.
+//
+// Same algorithms as avl.c, but nodes are addressed by their index
+// in the Nodes array, and hold no payload.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cavl.h"
+
+
+//
+// CAVLCreate:
+//
+// Dynamically creates and returns an empty compact tree.
+//
+CAVL *CAVLCreate() {
+
+	CAVL *tree = (CAVL*)malloc(sizeof(CAVL));
+
+	tree->Size = 64;
+	tree->Count = 0;
+	tree->Root = CAVL_NIL;
+	tree->Nodes = (CAVLNode*)malloc(sizeof(CAVLNode) * tree->Size);
+
+	return tree;
+}
+
+
+//
+// height of node i, -1 for CAVL_NIL
+//
+static int _cheight(CAVL *tree, unsigned int i) {
+
+	if (i == CAVL_NIL)
+		return -1;
+	else
+		return tree->Nodes[i].Height;
+}
+
+static void _cfixHeight(CAVL *tree, unsigned int i) {
+
+	int hl = _cheight(tree, tree->Nodes[i].Left);
+	int hr = _cheight(tree, tree->Nodes[i].Right);
+
+	tree->Nodes[i].Height = 1 + ((hl > hr) ? hl : hr);
+}
+
+
+//
+// Rotate right the sub-tree rooted at k2, returns the new root k1.
+//
+static unsigned int _CAVLRightRotate(CAVL *tree, unsigned int k2) {
+
+	unsigned int k1 = tree->Nodes[k2].Left;
+
+	tree->Nodes[k2].Left = tree->Nodes[k1].Right;
+	tree->Nodes[k1].Right = k2;
+
+	_cfixHeight(tree, k2);
+	_cfixHeight(tree, k1);
+
+	return k1;
+}
+
+//
+// Rotate left the sub-tree rooted at k1, returns the new root k2.
+//
+static unsigned int _CAVLLeftRotate(CAVL *tree, unsigned int k1) {
+
+	unsigned int k2 = tree->Nodes[k1].Right;
+
+	tree->Nodes[k1].Right = tree->Nodes[k2].Left;
+	tree->Nodes[k2].Left = k1;
+
+	_cfixHeight(tree, k1);
+	_cfixHeight(tree, k2);
+
+	return k2;
+}
+
+
+//
+// CAVLInsert:
+//
+// Inserts the key, rebalancing the tree as necessary.  Returns the
+// index of the new node -- where the caller stores the payload -- or
+// -1 if the key is already in the tree.
+//
+int CAVLInsert(CAVL *tree, AVLKey key) {
+
+	unsigned int stack[64];
+	int top = -1;
+	unsigned int cur = tree->Root;
+	unsigned int newNode;
+
+	// search, remembering the path
+	while (cur != CAVL_NIL) {
+		stack[++top] = cur;
+
+		if (key == tree->Nodes[cur].Key)	// already in tree, failed:
+			return -1;
+		else if (key < tree->Nodes[cur].Key)
+			cur = tree->Nodes[cur].Left;
+		else
+			cur = tree->Nodes[cur].Right;
+	}
+
+	// grow the array if needed, indices stay valid
+	if (tree->Count == tree->Size) {
+		tree->Size *= 2;
+		tree->Nodes = (CAVLNode*)realloc(tree->Nodes, sizeof(CAVLNode) * tree->Size);
+	}
+
+	newNode = (unsigned int)tree->Count;
+	tree->Count++;
+	tree->Nodes[newNode].Key = key;
+	tree->Nodes[newNode].Left = CAVL_NIL;
+	tree->Nodes[newNode].Right = CAVL_NIL;
+	tree->Nodes[newNode].Height = 0;
+
+	// link where we fell out of tree
+	if (top < 0)
+		tree->Root = newNode;
+	else if (key < tree->Nodes[stack[top]].Key)
+		tree->Nodes[stack[top]].Left = newNode;
+	else
+		tree->Nodes[stack[top]].Right = newNode;
+
+	// walk back up, updating heights until balanced or broken
+	while (top >= 0) {
+		unsigned int n = stack[top--];
+		int hl = _cheight(tree, tree->Nodes[n].Left);
+		int hr = _cheight(tree, tree->Nodes[n].Right);
+		int newH = 1 + ((hl > hr) ? hl : hr);
+		unsigned int fixed;
+
+		if (newH == tree->Nodes[n].Height)	// still an AVL tree
+			break;
+
+		if (abs(hl - hr) <= 1) {			// update height and continue
+			tree->Nodes[n].Height = newH;
+			continue;
+		}
+
+		// AVL condition broken at n, which of the 4 cases?
+		if (key < tree->Nodes[n].Key) {
+			if (key > tree->Nodes[tree->Nodes[n].Left].Key)
+				tree->Nodes[n].Left = _CAVLLeftRotate(tree, tree->Nodes[n].Left);
+			fixed = _CAVLRightRotate(tree, n);
+		}
+		else {
+			if (key < tree->Nodes[tree->Nodes[n].Right].Key)
+				tree->Nodes[n].Right = _CAVLRightRotate(tree, tree->Nodes[n].Right);
+			fixed = _CAVLLeftRotate(tree, n);
+		}
+
+		// link the rotated sub-tree to n's parent
+		if (top < 0)
+			tree->Root = fixed;
+		else if (tree->Nodes[stack[top]].Left == n)
+			tree->Nodes[stack[top]].Left = fixed;
+		else
+			tree->Nodes[stack[top]].Right = fixed;
+		break;
+	}
+
+	return (int)newNode;
+}
+
+
+//
+// CAVLSearch:
+//
+// Returns the index of the node with the key, or -1 if not found.
+//
+int CAVLSearch(CAVL *tree, AVLKey key) {
+
+	const CAVLNode *nodes = tree->Nodes;
+	unsigned int cur = tree->Root;
+
+	while (cur != CAVL_NIL) {
+		if (key == nodes[cur].Key)
+			return (int)cur;
+		else if (key < nodes[cur].Key)
+			cur = nodes[cur].Left;
+		else
+			cur = nodes[cur].Right;
+	}
+
+	return -1;		// not found
+}
+
+
+//
+// recursively links nodes [lo, hi) into a perfectly balanced tree,
+// returns the root
+//
+static unsigned int _CAVLBuild(CAVL *tree, int lo, int hi) {
+
+	// base case
+	if (lo >= hi)
+		return CAVL_NIL;
+
+	int mid = lo + (hi - lo) / 2;
+
+	tree->Nodes[mid].Left = _CAVLBuild(tree, lo, mid);
+	tree->Nodes[mid].Right = _CAVLBuild(tree, mid + 1, hi);
+	_cfixHeight(tree, (unsigned int)mid);
+
+	return (unsigned int)mid;
+}
+
+
+//
+// CAVLBuildFromSorted:
+//
+// Builds a height-optimal tree from keys sorted with no duplicates, in
+// O(N); node i holds keys[i].  The tree must be empty, returns count.
+//
+int CAVLBuildFromSorted(CAVL *tree, const AVLKey *keys, int count) {
+
+	int i;
+
+	if (count > tree->Size) {
+		tree->Size = count;
+		tree->Nodes = (CAVLNode*)realloc(tree->Nodes, sizeof(CAVLNode) * tree->Size);
+	}
+
+	for (i = 0; i < count; i++)
+		tree->Nodes[i].Key = keys[i];
+
+	tree->Count = count;
+	tree->Root = _CAVLBuild(tree, 0, count);
+
+	return count;
+}
+
+
+//
+// CAVLCount:
+//
+// Returns # of nodes in the tree.
+//
+int CAVLCount(CAVL *tree) {
+
+	return tree->Count;
+}
+
+
+//
+// CAVLHeight:
+//
+// Returns the overall height of the tree.
+//
+int CAVLHeight(CAVL *tree) {
+
+	return _cheight(tree, tree->Root);
+}
+
+
+//
+// CAVLFree:
+//
+// Frees the tree, payload arrays are the caller's.
+//
+void CAVLFree(CAVL *tree) {
+
+	free(tree->Nodes);
+	free(tree);
+}
@@ -0,0 +1,59 @@
+/*cavl.h*/
+
+//
+// Compact AVL tree, header file.
+//
+// Alternative layout to AVLNode: a node only holds what the search
+// path needs -- key, 32-bit child indices and height, 16 bytes -- and
+// nodes live in one array.  The index of a node is also the row of its
+// payload, which the caller keeps in an array of its own type, so a
+// search touches 16 bytes per level instead of a whole AVLNode with
+// its value.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "avl.h"
+
+#define CAVL_NIL 0xFFFFFFFFu	// "NULL" child index
+
+
+//
+// compact AVL type declarations:
+//
+typedef struct CAVLNode
+{
+	AVLKey			Key;
+	unsigned int	Left;
+	unsigned int	Right;
+	int				Height;
+
+} CAVLNode;
+
+// tree handle, node i was the i-th key inserted
+typedef struct CAVL
+{
+	CAVLNode		*Nodes;
+	unsigned int	Root;
+	int				Count;
+	int				Size;		// room in Nodes
+
+} CAVL;
+
+
+//
+// compact AVL API:
+// function prototypes
+//
+CAVL *CAVLCreate();
+int CAVLInsert(CAVL *tree, AVLKey key);
+int CAVLSearch(CAVL *tree, AVLKey key);
+int CAVLBuildFromSorted(CAVL *tree, const AVLKey *keys, int count);
+int CAVLCount(CAVL *tree);
+int CAVLHeight(CAVL *tree);
+void CAVLFree(CAVL *tree);
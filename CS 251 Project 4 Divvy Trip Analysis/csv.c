@@ -0,0 +1,519 @@
+/*csv.c*/
+
+//
+// Memory-mapped, zero-copy CSV reader, implementation file.
+//
+// The whole input file is mapped read-only and rows are scanned in
+// place: fields are (pointer, length) pairs into the mapping, and the
+// numbers are converted straight from there, so no line buffers,
+// strtok() or per-line copies are involved.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#define _DEFAULT_SOURCE		// madvise under -std=c11
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "csv.h"
+
+
+//
+// MapFile:
+//
+// Maps the file into memory, read-only.  Returns TRUE (non-zero) if
+// successful, FALSE (0) if the file can't be opened.  An empty file
+// is mapped as Data == NULL, Size == 0.
+//
+int MapFile(MappedFile *file, const char *filename) {
+
+	file->Data = NULL;
+	file->Size = 0;
+
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	LARGE_INTEGER size;
+
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return 0;
+
+	GetFileSizeEx(fileHandle, &size);
+	if (size.QuadPart > 0) {
+		HANDLE mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL) {
+			file->Data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			CloseHandle(mapping);		// the view keeps the mapping alive
+		}
+		if (file->Data == NULL) {
+			CloseHandle(fileHandle);
+			return 0;
+		}
+		file->Size = (size_t)size.QuadPart;
+	}
+
+	CloseHandle(fileHandle);
+#else
+	int fd = open(filename, O_RDONLY);
+	struct stat info;
+
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return 0;
+	}
+
+	if (info.st_size > 0) {
+		void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			return 0;
+		}
+		madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+		file->Data = (const char*)data;
+		file->Size = (size_t)info.st_size;
+	}
+
+	close(fd);		// the mapping stays valid
+#endif
+
+	return 1;
+}
+
+
+//
+// UnmapFile:
+//
+// Releases the mapping.
+//
+void UnmapFile(MappedFile *file) {
+
+	if (file->Data != NULL) {
+#ifdef _WIN32
+		UnmapViewOfFile((LPCVOID)file->Data);
+#else
+		munmap((void*)file->Data, file->Size);
+#endif
+	}
+
+	file->Data = NULL;
+	file->Size = 0;
+}
+
+
+//
+// CSVInit:
+//
+// Positions the reader at the start of data[0, size).
+//
+void CSVInit(CSVReader *reader, const char *data, size_t size) {
+
+	reader->Cur = data;
+	reader->End = data + size;
+}
+
+
+//
+// CSVNextRow:
+//
+// Scans the next non-empty row, storing up to maxFields fields; the
+// rest of the row is skipped.  Quoted fields may contain commas,
+// newlines and "" escapes.  Returns # of fields in the row, or 0 when
+// there are no more rows.
+//
+int CSVNextRow(CSVReader *reader, CSVField *fields, int maxFields) {
+
+	const char *p = reader->Cur;
+	const char *end = reader->End;
+	int count = 0;
+
+	// skip empty lines
+	while (p < end && (*p == '\n' || *p == '\r'))
+		p++;
+
+	if (p >= end) {
+		reader->Cur = p;
+		return 0;		// no more rows
+	}
+
+	for (;;) {
+		const char *start;
+		int quoted = 0;
+
+		if (p < end && *p == '"') {
+			// quoted field, runs until a quote not followed by another quote
+			quoted = 1;
+			start = ++p;
+			while (p < end) {
+				if (*p == '"') {
+					if (p + 1 < end && p[1] == '"')
+						p += 2;		// "" => escaped quote
+					else
+						break;
+				}
+				else
+					p++;
+			}
+
+			if (count < maxFields) {
+				fields[count].Start = start;
+				fields[count].Length = (int)(p - start);
+				fields[count].Quoted = quoted;
+			}
+
+			// skip closing quote and anything up to the separator
+			while (p < end && *p != ',' && *p != '\n')
+				p++;
+		}
+		else {
+			// plain field, runs until separator or end of line
+			start = p;
+			while (p < end && *p != ',' && *p != '\n')
+				p++;
+
+			if (count < maxFields) {
+				const char *last = p;
+				if (last > start && last[-1] == '\r')	// CRLF files
+					last--;
+				fields[count].Start = start;
+				fields[count].Length = (int)(last - start);
+				fields[count].Quoted = quoted;
+			}
+		}
+
+		count++;
+
+		if (p < end && *p == ',') {
+			p++;		// next field
+			continue;
+		}
+
+		if (p < end)
+			p++;		// skip '\n'
+		break;
+	}
+
+	reader->Cur = p;
+	return count;
+}
+
+
+//
+// CSVNextRowStart:
+//
+// Returns the start of the first row at or after p, end if there is
+// none; data is the start of a row at or before p.  A '\n' inside a
+// quoted field doesn't end a row, so the quotes in [data, p) are
+// counted first, with memchr -- much faster than parsing the rows.
+// For well-formed CSV, where quotes only open and close fields or
+// come doubled inside them, rows start where CSVNextRow starts them.
+//
+const char *CSVNextRowStart(const char *data, const char *p, const char *end) {
+
+	const char *q = data;
+	int quoted = 0;			// inside quotes at p
+
+	while (q < p && (q = (const char*)memchr(q, '"', p - q)) != NULL) {
+		quoted = !quoted;
+		q++;
+	}
+
+	if (p == data)
+		return p;
+
+	// a row starts after a '\n' outside of quotes
+	while (p < end && (p[-1] != '\n' || quoted)) {
+		if (*p == '"')
+			quoted = !quoted;
+		p++;
+	}
+
+	return p;
+}
+
+
+//
+// CSVParseInt:
+//
+// Converts the field to int, like atoi(): optional sign followed by
+// digits, conversion stops at the first non-digit.
+//
+int CSVParseInt(const CSVField *field) {
+
+	const char *p = field->Start;
+	const char *end = p + field->Length;
+	int negative = 0;
+	int value = 0;
+
+	// skip leading spaces
+	while (p < end && *p == ' ')
+		p++;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+
+	while (p < end && *p >= '0' && *p <= '9') {
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+
+	return negative ? -value : value;
+}
+
+
+//
+// CSVParseDouble:
+//
+// Converts the field to double, giving the same result as atof().
+// Numbers with up to 15 significant digits and no exponent -- i.e.
+// every coordinate in the Divvy files -- are converted by dividing the
+// exact integer mantissa by an exact power of 10, which is correctly
+// rounded.  Anything else falls back to strtod().
+//
+static int _CSVParseDoubleFast(const char *p, const char *end, double *result) {
+
+	static const double powersOf10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22
+	};
+	int negative = 0;
+	long long mantissa = 0;
+	int digits = 0;				// significant digits
+	int anyDigits = 0;
+	int fractionDigits = 0;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+
+	// integer part
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (mantissa != 0 || *p != '0')
+			digits++;
+		if (digits <= 15)
+			mantissa = mantissa * 10 + (*p - '0');
+		anyDigits = 1;
+		p++;
+	}
+
+	// fraction part
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (mantissa != 0 || *p != '0')
+				digits++;
+			if (digits <= 15)
+				mantissa = mantissa * 10 + (*p - '0');
+			anyDigits = 1;
+			fractionDigits++;
+			p++;
+		}
+	}
+
+	// exponent, too many digits or trailing junk => not handled here
+	if (p != end || !anyDigits || digits > 15 || fractionDigits > 22)
+		return 0;
+
+	*result = (double)mantissa / powersOf10[fractionDigits];
+	if (negative)
+		*result = -*result;
+
+	return 1;
+}
+
+double CSVParseDouble(const CSVField *field) {
+
+	const char *p = field->Start;
+	const char *end = p + field->Length;
+	char buffer[64];
+	double result;
+
+	// skip leading spaces
+	while (p < end && *p == ' ')
+		p++;
+
+	if (_CSVParseDoubleFast(p, end, &result))
+		return result;
+
+	// slow path: strtod needs a terminated copy
+	int length = (int)(end - p);
+	if (length > (int)sizeof(buffer) - 1)
+		length = (int)sizeof(buffer) - 1;
+	memcpy(buffer, p, length);
+	buffer[length] = '\0';
+
+	return strtod(buffer, NULL);
+}
+
+
+//
+// reads 1 or more digits at *p, returns -1 if there are none
+//
+static int _CSVDigits(const char **p, const char *end) {
+
+	int value = 0;
+
+	if (*p >= end || **p < '0' || **p > '9')
+		return -1;
+
+	while (*p < end && **p >= '0' && **p <= '9') {
+		value = value * 10 + (**p - '0');
+		(*p)++;
+	}
+
+	return value;
+}
+
+
+//
+// # of days from 1970-01-01 to the given date, proleptic Gregorian
+// calendar; the year is shifted to start in March, so the leap day
+// is the last day of the year
+//
+static long long _CSVDaysFromCivil(int year, int month, int day) {
+
+	year -= (month <= 2);
+	long long era = (year >= 0 ? year : year - 399) / 400;
+	int yearOfEra = (int)(year - era * 400);							// [0, 399]
+	int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;	// [0, 365]
+	int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+	return era * 146097 + dayOfEra - 719468;
+}
+
+
+//
+// CSVParseDateTime:
+//
+// Converts a "M/D/YYYY H:MM[:SS]" timestamp, as in the Divvy trip files,
+// or a "YYYY-MM-DD[ H:MM[:SS]]" one, to seconds since 1970-01-01 00:00.
+// The time is taken as written, there is no time zone conversion.
+// Returns -1 if the field is not such a timestamp.
+//
+long long CSVParseDateTime(const CSVField *field) {
+
+	const char *p = field->Start;
+	const char *end = p + field->Length;
+	int year, month, day;
+	int hour = 0, minute = 0, second = 0;
+	int first;
+
+	// skip leading spaces
+	while (p < end && *p == ' ')
+		p++;
+
+	first = _CSVDigits(&p, end);
+	if (first < 0 || p >= end)
+		return -1;
+
+	if (*p == '/') {				// M/D/YYYY
+		month = first;
+		p++;
+		day = _CSVDigits(&p, end);
+		if (day < 0 || p >= end || *p != '/')
+			return -1;
+		p++;
+		year = _CSVDigits(&p, end);
+	}
+	else if (*p == '-') {			// YYYY-MM-DD
+		year = first;
+		p++;
+		month = _CSVDigits(&p, end);
+		if (month < 0 || p >= end || *p != '-')
+			return -1;
+		p++;
+		day = _CSVDigits(&p, end);
+	}
+	else
+		return -1;
+
+	if (year < 0 || day < 1 || day > 31 || month < 1 || month > 12)
+		return -1;
+
+	// optional time
+	while (p < end && (*p == ' ' || *p == 'T'))
+		p++;
+	if (p < end) {
+		hour = _CSVDigits(&p, end);
+		if (hour < 0 || p >= end || *p != ':')
+			return -1;
+		p++;
+		minute = _CSVDigits(&p, end);
+		if (minute < 0)
+			return -1;
+		if (p < end && *p == ':') {
+			p++;
+			second = _CSVDigits(&p, end);
+			if (second < 0)
+				return -1;
+		}
+	}
+
+	return _CSVDaysFromCivil(year, month, day) * 86400LL + hour * 3600 + minute * 60 + second;
+}
+
+
+//
+// CSVCopyField:
+//
+// Copies the field into dest as a '\0' terminated string, turning ""
+// back into ".  Returns # of chars copied, not counting the '\0'.
+//
+int CSVCopyField(const CSVField *field, char *dest) {
+
+	int i, n = 0;
+
+	if (!field->Quoted) {
+		memcpy(dest, field->Start, field->Length);
+		n = field->Length;
+	}
+	else {
+		for (i = 0; i < field->Length; i++) {
+			dest[n++] = field->Start[i];
+			if (field->Start[i] == '"')		// skip the second quote
+				i++;
+		}
+	}
+
+	dest[n] = '\0';
+	return n;
+}
+
+
+//
+// CSVReportThroughput:
+//
+// Outputs how fast the file was loaded, to stderr so the regular
+// output stays the same.
+//
+void CSVReportThroughput(const char *filename, size_t bytes, int rows, double seconds) {
+
+	double mb = (double)bytes / (1024.0 * 1024.0);
+
+	if (seconds <= 0)
+		seconds = 1e-9;
+
+	fprintf(stderr, "** Loaded '%s': %d rows, %.1f MB in %.3f secs (%.1f MB/s, %.0f rows/s)\n",
+		filename, rows, mb, seconds, mb / seconds, rows / seconds);
+}
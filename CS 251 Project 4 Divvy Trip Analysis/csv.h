@@ -0,0 +1,61 @@
+/*csv.h*/
+
+//
+// Memory-mapped, zero-copy CSV reader, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include <stddef.h>
+
+
+//
+// CSV type declarations:
+//
+
+// read-only view of a whole file
+typedef struct MappedFile
+{
+	const char	*Data;
+	size_t		Size;
+
+} MappedFile;
+
+// one field of a row, points into the mapped file
+typedef struct CSVField
+{
+	const char	*Start;
+	int			Length;
+	int			Quoted;		// TRUE if "" escapes may be inside
+
+} CSVField;
+
+// position in the file
+typedef struct CSVReader
+{
+	const char	*Cur;
+	const char	*End;
+
+} CSVReader;
+
+
+//
+// CSV API:
+// function prototypes
+//
+int MapFile(MappedFile *file, const char *filename);
+void UnmapFile(MappedFile *file);
+
+void CSVInit(CSVReader *reader, const char *data, size_t size);
+int CSVNextRow(CSVReader *reader, CSVField *fields, int maxFields);
+const char *CSVNextRowStart(const char *data, const char *p, const char *end);
+int CSVParseInt(const CSVField *field);
+double CSVParseDouble(const CSVField *field);
+long long CSVParseDateTime(const CSVField *field);
+int CSVCopyField(const CSVField *field, char *dest);
+void CSVReportThroughput(const char *filename, size_t bytes, int rows, double seconds);
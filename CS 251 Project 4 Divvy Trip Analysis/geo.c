@@ -0,0 +1,187 @@
+/*geo.c*/
+
+//
+// Batched great-circle distance test, implementation file.
+//
+// distBetween2Points() is earth_rad * acos(dot(u1, u2)), u1 and u2 the
+// unit vectors of the 2 points, and acos() is decreasing, so
+//
+//     distance <= d   <=>   dot(u1, u2) >= cos(d / earth_rad)
+//
+// The unit vectors of the stations are computed once, the query's once
+// per query, and a block of stations is then tested with one multiply-
+// add chain and compare each -- no trig at all.  The vectors use the
+// same math as distBetween2Points, but the dot product is summed in a
+// different order, so the two can differ in the last few bits: the
+// threshold is lowered by GEO_TOLERANCE (~0.06 ft at 3963.1 miles) and
+// the kernel only answers "maybe".  Callers confirm the survivors with
+// distBetween2Points, which they need anyway for the exact distance, so
+// the results are the same as testing every station with it.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GEO_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GEO_SSE2
+#endif
+
+#include "geo.h"
+
+
+//
+// GeoUnitVector:
+//
+// Computes the unit vector of the point (latitude, longtitude).
+//
+void GeoUnitVector(double latitude, double longtitude, double v[3]) {
+
+	double lat_rad = latitude * GEO_PI / 180.0;
+	double long_rad = longtitude * GEO_PI / 180.0;
+
+	v[0] = cos(lat_rad) * cos(long_rad);
+	v[1] = cos(lat_rad) * sin(long_rad);
+	v[2] = sin(lat_rad);
+}
+
+
+//
+// GeoThreshold:
+//
+// Returns the smallest dot product a point within distance miles can
+// have, lowered by GEO_TOLERANCE.  Above 1 => nothing can match, -2 =>
+// everything can.
+//
+double GeoThreshold(double distance) {
+
+	double angle = distance / GEO_EARTH_RAD;
+
+	if (angle < 0)				// acos() is never negative
+		return 2.0;
+	if (angle >= GEO_PI)		// the whole globe
+		return -2.0;
+
+	return cos(angle) - GEO_TOLERANCE;
+}
+
+
+//
+// GeoVectorsCreate:
+//
+// Creates room for count unit vectors.
+//
+GeoVectors *GeoVectorsCreate(int count) {
+
+	GeoVectors *vectors = (GeoVectors*)malloc(sizeof(GeoVectors));
+
+	vectors->Count = count;
+	vectors->X = (double*)malloc(sizeof(double) * (count + 1));
+	vectors->Y = (double*)malloc(sizeof(double) * (count + 1));
+	vectors->Z = (double*)malloc(sizeof(double) * (count + 1));
+
+	return vectors;
+}
+
+
+//
+// GeoVectorsSet:
+//
+// Stores the unit vector of (latitude, longtitude) as vector i.
+//
+void GeoVectorsSet(GeoVectors *vectors, int i, double latitude, double longtitude) {
+
+	double v[3];
+
+	GeoUnitVector(latitude, longtitude, v);
+	vectors->X[i] = v[0];
+	vectors->Y[i] = v[1];
+	vectors->Z[i] = v[2];
+}
+
+
+//
+// GeoWithin:
+//
+// Sets mask[i - lo] to TRUE (1) if vector i, lo <= i < hi, may be
+// within range of the query, i.e. its dot product with query is at
+// least threshold, FALSE (0) if it is certainly not.
+//
+void GeoWithin(const GeoVectors *vectors, int lo, int hi, const double query[3],
+	double threshold, unsigned char *mask) {
+
+	const double *x = vectors->X;
+	const double *y = vectors->Y;
+	const double *z = vectors->Z;
+	int i = lo;
+
+#if defined(GEO_AVX2)
+	__m256d qx = _mm256_set1_pd(query[0]);
+	__m256d qy = _mm256_set1_pd(query[1]);
+	__m256d qz = _mm256_set1_pd(query[2]);
+	__m256d limit = _mm256_set1_pd(threshold);
+
+	// 4 at a time
+	for (; i + 4 <= hi; i += 4) {
+		__m256d dot = _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(_mm256_loadu_pd(x + i), qx),
+			_mm256_mul_pd(_mm256_loadu_pd(y + i), qy)),
+			_mm256_mul_pd(_mm256_loadu_pd(z + i), qz));
+		int bits = _mm256_movemask_pd(_mm256_cmp_pd(dot, limit, _CMP_GE_OQ));
+
+		mask[i - lo] = bits & 1;
+		mask[i - lo + 1] = (bits >> 1) & 1;
+		mask[i - lo + 2] = (bits >> 2) & 1;
+		mask[i - lo + 3] = (bits >> 3) & 1;
+	}
+#elif defined(GEO_SSE2)
+	__m128d qx = _mm_set1_pd(query[0]);
+	__m128d qy = _mm_set1_pd(query[1]);
+	__m128d qz = _mm_set1_pd(query[2]);
+	__m128d limit = _mm_set1_pd(threshold);
+
+	// 2 at a time
+	for (; i + 2 <= hi; i += 2) {
+		__m128d dot = _mm_add_pd(_mm_add_pd(
+			_mm_mul_pd(_mm_loadu_pd(x + i), qx),
+			_mm_mul_pd(_mm_loadu_pd(y + i), qy)),
+			_mm_mul_pd(_mm_loadu_pd(z + i), qz));
+		int bits = _mm_movemask_pd(_mm_cmpge_pd(dot, limit));
+
+		mask[i - lo] = bits & 1;
+		mask[i - lo + 1] = (bits >> 1) & 1;
+	}
+#endif
+
+	// the rest, or all of it without SIMD
+	for (; i < hi; i++) {
+		double dot = x[i] * query[0] + y[i] * query[1] + z[i] * query[2];
+		mask[i - lo] = (dot >= threshold);
+	}
+}
+
+
+//
+// GeoVectorsFree:
+//
+// Frees the vectors.
+//
+void GeoVectorsFree(GeoVectors *vectors) {
+
+	free(vectors->X);
+	free(vectors->Y);
+	free(vectors->Z);
+	free(vectors);
+}
@@ -0,0 +1,46 @@
+/*geo.h*/
+
+//
+// Batched great-circle distance test, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+
+#define GEO_PI			3.14159265	// same constants as distBetween2Points
+#define GEO_EARTH_RAD	3963.1		// statue miles
+#define GEO_TOLERANCE	1e-9		// slack on the dot product threshold
+
+
+//
+// geo type declarations:
+//
+
+// unit vectors of a set of points, structure-of-arrays so the kernel
+// can load 2 or 4 of each coordinate at once
+typedef struct GeoVectors
+{
+	double	*X;
+	double	*Y;
+	double	*Z;
+	int		Count;
+
+} GeoVectors;
+
+
+//
+// geo API:
+// function prototypes
+//
+void GeoUnitVector(double latitude, double longtitude, double v[3]);
+double GeoThreshold(double distance);
+GeoVectors *GeoVectorsCreate(int count);
+void GeoVectorsSet(GeoVectors *vectors, int i, double latitude, double longtitude);
+void GeoWithin(const GeoVectors *vectors, int lo, int hi, const double query[3],
+	double threshold, unsigned char *mask);
+void GeoVectorsFree(GeoVectors *vectors);
@@ -0,0 +1,294 @@
+/*idtable.c*/
+
+//
+// Direct-mapped lookup by ID, implementation file.
+//
+// Station and bike IDs are small, mostly dense integers, so an array
+// indexed by ID finds them in one step instead of an O(log N) walk
+// down the tree.  A table is only built when the IDs are dense enough
+// for the array to stay small; otherwise lookups go to the tree.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "idtable.h"
+
+
+//
+// finds the smallest and largest key of the tree
+//
+static void _IDRange(AVL *tree, AVLKey *min, AVLKey *max) {
+
+	AVLNode *cur = tree->Root;
+
+	while (cur->Left != NULL)
+		cur = cur->Left;
+	*min = cur->Key;
+
+	cur = tree->Root;
+	while (cur->Right != NULL)
+		cur = cur->Right;
+	*max = cur->Key;
+}
+
+
+//
+// stores the node in its slot, visitor for AVLTraverse
+//
+static int _IDFill(AVLNode *node, void *arg) {
+
+	IDTable *table = (IDTable*)arg;
+
+	table->Slots[node->Key - table->MinID] = node;
+
+	return TRUE;		// keep going
+}
+
+
+//
+// IDTableBuild:
+//
+// Builds the table of the tree's nodes by ID.  Returns NULL if the
+// tree is empty or its IDs are too spread out, in which case
+// IDTableSearch falls back to the tree.
+//
+IDTable *IDTableBuild(AVL *tree) {
+
+	AVLKey min, max;
+	long long range;
+
+	if (tree->Root == NULL)
+		return NULL;
+
+	// density check
+	_IDRange(tree, &min, &max);
+	range = (long long)max - min + 1;
+	if (range > IDTABLE_MAX_RANGE
+		|| (range > IDTABLE_MIN_RANGE && range > (long long)IDTABLE_DENSITY * AVLCount(tree)))
+		return NULL;
+
+	IDTable *table = (IDTable*)malloc(sizeof(IDTable));
+	table->MinID = min;
+	table->Range = (int)range;
+	table->Slots = (AVLNode**)calloc(table->Range, sizeof(AVLNode*));
+
+	AVLTraverse(tree->Root, AVLPreOrder, _IDFill, table);
+
+	return table;
+}
+
+
+//
+// # of pairs with a key below key, pairs sorted
+//
+static int _IDLowerBound(const AVLPair *pairs, int count, AVLKey key) {
+
+	int low = 0, high = count;
+
+	while (low < high) {
+		int mid = low + (high - low) / 2;
+
+		if (pairs[mid].Key < key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+
+//
+// stores the nodes of the subtree not in their slots yet.  A node in
+// its slot is the one from before, and so is everything below it --
+// a new node is only ever linked in by a new parent, see AVLInsert --
+// unless one of the keys of pairs is below it: the tree may have
+// changed in place there.  Returns FALSE if a node falls outside the
+// table.
+//
+static int _IDRefresh(IDTable *table, AVLNode *node, const AVLPair *pairs, int count) {
+
+	long long slot;
+	int fresh, left, right;
+
+	if (node == NULL)
+		return TRUE;
+
+	slot = (long long)node->Key - table->MinID;
+	if (slot < 0 || slot >= table->Range)
+		return FALSE;
+
+	fresh = (table->Slots[slot] != node);
+	table->Slots[slot] = node;
+
+	// pairs[0, left) go left of node, pairs[right, count) right of it
+	left = _IDLowerBound(pairs, count, node->Key);
+	right = (left < count && pairs[left].Key == node->Key) ? left + 1 : left;
+
+	if ((fresh || left > 0) && !_IDRefresh(table, node->Left, pairs, left))
+		return FALSE;
+	if ((fresh || right < count) && !_IDRefresh(table, node->Right, pairs + right, count - right))
+		return FALSE;
+
+	return TRUE;
+}
+
+
+//
+// IDTableUpdate:
+//
+// Brings the table up to date after the tree changed at the keys of
+// pairs, sorted, see AVLUpdate and AVLMerge: only the nodes that were
+// copied or inserted are stored, O(k log N) for k keys instead of the
+// O(N) of a new table.  The table is built again instead if a key
+// falls outside it, or tried again if there was none.  Returns the
+// table to use from now on, see IDTableBuild.
+//
+IDTable *IDTableUpdate(IDTable *table, AVL *tree, const AVLPair *pairs, int count) {
+
+	if (table != NULL && _IDRefresh(table, tree->Root, pairs, count))
+		return table;
+
+	IDTableFree(table);
+	return IDTableBuild(tree);
+}
+
+
+//
+// IDTableSearch:
+//
+// Same as AVLSearch(tree, key), but with one array lookup if there is
+// a table.
+//
+AVLNode *IDTableSearch(IDTable *table, AVL *tree, AVLKey key) {
+
+	long long slot;
+
+	if (table == NULL)
+		return AVLSearch(tree, key);
+
+	// in long long, key - MinID doesn't overflow for any two ints
+	slot = (long long)key - table->MinID;
+	if (slot < 0 || slot >= table->Range)
+		return NULL;
+
+	return table->Slots[slot];
+}
+
+
+//
+// IDTableFree:
+//
+// Frees the table, NULL is fine.
+//
+void IDTableFree(IDTable *table) {
+
+	if (table == NULL)
+		return;
+
+	free(table->Slots);
+	free(table);
+}
+
+
+//
+// IDCountsCreate:
+//
+// Creates empty counts.
+//
+IDCounts *IDCountsCreate() {
+
+	IDCounts *counts = (IDCounts*)malloc(sizeof(IDCounts));
+
+	counts->DenseSize = 1024;
+	counts->Dense = (int*)calloc(counts->DenseSize, sizeof(int));
+	counts->Sparse = CAVLCreate();
+	counts->SparseSize = 64;
+	counts->SparseCounts = (int*)malloc(sizeof(int) * counts->SparseSize);
+
+	return counts;
+}
+
+
+//
+// IDCountsAdd:
+//
+// Adds n trips to id: an array increment, unless id is negative or
+// not below IDCOUNTS_MAX.
+//
+void IDCountsAdd(IDCounts *counts, AVLKey id, int n) {
+
+	if (id >= 0 && id < IDCOUNTS_MAX) {
+		// grow the array if needed
+		if (id >= counts->DenseSize) {
+			int size = counts->DenseSize;
+			while (size <= id)
+				size *= 2;
+			if (size > IDCOUNTS_MAX)
+				size = IDCOUNTS_MAX;
+
+			counts->Dense = (int*)realloc(counts->Dense, sizeof(int) * size);
+			memset(&counts->Dense[counts->DenseSize], 0, sizeof(int) * (size - counts->DenseSize));
+			counts->DenseSize = size;
+		}
+
+		counts->Dense[id] += n;
+		return;
+	}
+
+	int slot = CAVLSearch(counts->Sparse, id);
+
+	if (slot < 0) {		// first time, insert it
+		slot = CAVLInsert(counts->Sparse, id);
+		if (slot >= counts->SparseSize) {
+			counts->SparseSize *= 2;
+			counts->SparseCounts = (int*)realloc(counts->SparseCounts,
+				sizeof(int) * counts->SparseSize);
+		}
+		counts->SparseCounts[slot] = n;
+	}
+	else
+		counts->SparseCounts[slot] += n;
+}
+
+
+//
+// IDCountsMerge:
+//
+// Adds the other counts into counts.
+//
+void IDCountsMerge(IDCounts *counts, IDCounts *other) {
+
+	int i;
+
+	for (i = 0; i < other->DenseSize; i++) {
+		if (other->Dense[i] != 0)
+			IDCountsAdd(counts, i, other->Dense[i]);
+	}
+
+	for (i = 0; i < CAVLCount(other->Sparse); i++)
+		IDCountsAdd(counts, other->Sparse->Nodes[i].Key, other->SparseCounts[i]);
+}
+
+
+//
+// IDCountsFree:
+//
+// Frees the counts.
+//
+void IDCountsFree(IDCounts *counts) {
+
+	free(counts->Dense);
+	CAVLFree(counts->Sparse);
+	free(counts->SparseCounts);
+	free(counts);
+}
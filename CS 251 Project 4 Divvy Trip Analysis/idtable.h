@@ -0,0 +1,61 @@
+/*idtable.h*/
+
+//
+// Direct-mapped lookup by ID, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "avl.h"
+#include "cavl.h"
+
+#define IDTABLE_MIN_RANGE	65536		// always dense enough below this
+#define IDTABLE_MAX_RANGE	(1 << 24)	// never a table above this
+#define IDTABLE_DENSITY		8			// else at most 8 slots per node
+#define IDCOUNTS_MAX		(1 << 22)	// dense counts for IDs below this
+
+
+//
+// ID table type declarations:
+//
+
+// node of every ID in [MinID, MinID + Range), NULL if not in the tree
+struct IDTable
+{
+	AVLKey		MinID;
+	int			Range;
+	AVLNode		**Slots;
+
+};
+
+// trip counts by ID, while loading: a plain array for IDs in
+// [0, IDCOUNTS_MAX), a compact tree for anything else
+typedef struct IDCounts
+{
+	int			*Dense;			// Dense[id] == # of trips, 0 => not seen
+	int			DenseSize;
+	CAVL		*Sparse;		// node i is the ID of SparseCounts[i]
+	int			*SparseCounts;
+	int			SparseSize;		// room in SparseCounts
+
+} IDCounts;
+
+
+//
+// ID table API:
+// function prototypes
+//
+IDTable *IDTableBuild(AVL *tree);
+IDTable *IDTableUpdate(IDTable *table, AVL *tree, const AVLPair *pairs, int count);
+AVLNode *IDTableSearch(IDTable *table, AVL *tree, AVLKey key);
+void IDTableFree(IDTable *table);
+
+IDCounts *IDCountsCreate();
+void IDCountsAdd(IDCounts *counts, AVLKey id, int n);
+void IDCountsMerge(IDCounts *counts, IDCounts *other);
+void IDCountsFree(IDCounts *counts);
@@ -0,0 +1,276 @@
+/*ingest.c*/
+
+//
+// Incremental trip ingestion, implementation file.
+//
+// Every trips file rows were appended from is remembered with how far
+// it has been read, always up to the end of a line, so "append f"
+// only parses what was added to f since and hands those rows to
+// AVLAppendTrips; a last line with no '\n' yet is still being written
+// and is left for next time.  The trips file loaded at start-up counts
+// as read up to the end of its last line.  Files are told apart by
+// device and inode, so another path to a file read before continues
+// where it left off.  Followed files are read again before every
+// interactive query, which makes a growing trips file show up in the
+// queries without a restart.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "ingest.h"
+#include "csv.h"
+
+
+//
+// IngestCreate:
+//
+// Creates an empty list of files.
+//
+IngestFiles *IngestCreate() {
+
+	IngestFiles *files = (IngestFiles*)malloc(sizeof(IngestFiles));
+
+	files->Size = 4;
+	files->Count = 0;
+	files->Files = (IngestFile*)malloc(sizeof(IngestFile) * files->Size);
+
+	return files;
+}
+
+
+//
+// gets the device and inode of the file -- on Windows the volume and
+// file index -- the same for every path to it.  Returns FALSE if the
+// file can't be opened.
+//
+static int _IngestFileID(const char *fileName, unsigned long long *device,
+	unsigned long long *inode) {
+
+#ifdef _WIN32
+	BY_HANDLE_FILE_INFORMATION info;
+	HANDLE fileHandle = CreateFileA(fileName, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	BOOL ok;
+
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	ok = GetFileInformationByHandle(fileHandle, &info);
+	CloseHandle(fileHandle);
+	if (!ok)
+		return FALSE;
+
+	*device = info.dwVolumeSerialNumber;
+	*inode = ((unsigned long long)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+#else
+	struct stat info;
+
+	if (stat(fileName, &info) != 0)
+		return FALSE;
+
+	*device = (unsigned long long)info.st_dev;
+	*inode = (unsigned long long)info.st_ino;
+#endif
+
+	return TRUE;
+}
+
+
+//
+// returns the file called fileName -- the same file by another name,
+// else one by that name -- adding it, not read yet, if new
+//
+static IngestFile *_IngestFind(IngestFiles *files, char *fileName) {
+
+	IngestFile *file;
+	unsigned long long device, inode;
+	int hasID = _IngestFileID(fileName, &device, &inode);
+	int i;
+
+	for (i = 0; hasID && i < files->Count; i++) {
+		file = &files->Files[i];
+		if (file->HasID && file->Device == device && file->Inode == inode)
+			return file;
+	}
+
+	for (i = 0; i < files->Count; i++) {
+		if (strcmp(files->Files[i].FileName, fileName) == 0)
+			return &files->Files[i];
+	}
+
+	// grow the array if needed
+	if (files->Count == files->Size) {
+		files->Size *= 2;
+		files->Files = (IngestFile*)realloc(files->Files, sizeof(IngestFile) * files->Size);
+	}
+
+	file = &files->Files[files->Count];
+	files->Count++;
+
+	file->FileName = (char*)malloc(strlen(fileName) + 1);
+	strcpy(file->FileName, fileName);
+	file->Offset = 0;
+	file->Follow = FALSE;
+	file->HasID = hasID;
+	file->Device = hasID ? device : 0;
+	file->Inode = hasID ? inode : 0;
+
+	return file;
+}
+
+
+//
+// IngestSkipFile:
+//
+// Counts the file as read up to the end of its last line, for the
+// trips file that was just loaded.  A last line with no '\n' is read
+// again by the next append, and skipped if its trip was loaded.
+//
+void IngestSkipFile(IngestFiles *files, char *fileName) {
+
+	IngestFile *file = _IngestFind(files, fileName);
+	MappedFile mapped;
+	const char *end;
+
+	if (MapFile(&mapped, fileName)) {
+		if (mapped.Size > 0) {
+			end = mapped.Data + mapped.Size;
+			while (end > mapped.Data && end[-1] != '\n')
+				end--;
+			file->Offset = end - mapped.Data;
+		}
+		UnmapFile(&mapped);
+	}
+}
+
+
+//
+// appends the rows added to the file since it was last read; reports
+// what was added, unless quiet and there was nothing new.  Returns
+// FALSE if the file can't be opened.
+//
+static int _IngestRead(DivvyData *data, IngestFile *file, Output *out, int quiet) {
+
+	MappedFile mapped;
+	AppendStats stats;
+	unsigned long long device, inode;
+
+	if (!MapFile(&mapped, file->FileName))
+		return FALSE;
+
+	// another file by that name now, or shorter than what was read: it
+	// was replaced, read it all again -- the rows of trips already
+	// loaded are skipped, see AVLAppendTrips
+	if (_IngestFileID(file->FileName, &device, &inode)
+		&& (!file->HasID || file->Device != device || file->Inode != inode)) {
+		if (file->HasID)
+			file->Offset = 0;
+		file->HasID = TRUE;
+		file->Device = device;
+		file->Inode = inode;
+	}
+	if ((long long)mapped.Size < file->Offset)
+		file->Offset = 0;
+
+	const char *begin = (mapped.Size > 0) ? mapped.Data + file->Offset : NULL;
+	const char *end = (mapped.Size > 0) ? mapped.Data + mapped.Size : NULL;
+
+	// whole lines only
+	while (end > begin && end[-1] != '\n')
+		end--;
+
+	// from the start of the file, skip the header line
+	if (file->Offset == 0 && begin < end)
+		begin = (const char*)memchr(begin, '\n', end - begin) + 1;
+
+	if (begin < end) {
+		AVLAppendTrips(data->Trips, data->Bikes, data->Stations, data->Routes, &data->BikeTrips,
+			&data->TripsByTime, &data->BikeTable, &data->StationTable, begin, end - begin, &stats);
+		file->Offset = end - mapped.Data;
+	}
+	else
+		memset(&stats, 0, sizeof(stats));
+
+	if (!quiet || stats.Rows > 0)
+		OutputPrintf(out, "** Append '%s': %d rows, %d new trips, %d duplicates, %d new bikes\n",
+			file->FileName, stats.Rows, stats.Inserted, stats.Rows - stats.Inserted, stats.NewBikes);
+
+	UnmapFile(&mapped);
+	return TRUE;
+}
+
+
+//
+// IngestAppend:
+//
+// Appends the rows added to the trips file since it was last read --
+// all of them the first time -- to the data, and reports what was
+// added.  If follow, the file is also read again before every query
+// from now on, see IngestPoll.  Returns FALSE if the file can't be
+// opened.
+//
+int IngestAppend(DivvyData *data, char *fileName, int follow, Output *out) {
+
+	IngestFile *file = _IngestFind(data->Files, fileName);
+
+	if (!_IngestRead(data, file, out, FALSE)) {
+		OutputPrintf(out, "**Error: unable to open '%s'\n", fileName);
+		return FALSE;
+	}
+
+	if (follow && !file->Follow) {
+		file->Follow = TRUE;
+		OutputPrintf(out, "** Following '%s'\n", fileName);
+	}
+
+	return TRUE;
+}
+
+
+//
+// IngestPoll:
+//
+// Appends the rows added to the followed files, and reports them if
+// there were any.
+//
+void IngestPoll(DivvyData *data, Output *out) {
+
+	int i;
+
+	for (i = 0; i < data->Files->Count; i++) {
+		if (data->Files->Files[i].Follow)
+			_IngestRead(data, &data->Files->Files[i], out, TRUE);
+	}
+}
+
+
+//
+// IngestFree:
+//
+// Frees the list of files.
+//
+void IngestFree(IngestFiles *files) {
+
+	int i;
+
+	for (i = 0; i < files->Count; i++)
+		free(files->Files[i].FileName);
+
+	free(files->Files);
+	free(files);
+}
@@ -0,0 +1,51 @@
+/*ingest.h*/
+
+//
+// Incremental trip ingestion, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "query.h"
+#include "output.h"
+
+
+//
+// ingestion type declarations:
+//
+
+// a trips file rows are appended from
+typedef struct IngestFile
+{
+	char		*FileName;
+	long long	Offset;		// bytes read so far, always at the start of a line
+	int			Follow;		// TRUE => read again before every query, see IngestPoll
+	int			HasID;		// TRUE if Device and Inode are known
+	unsigned long long Device;	// the file itself, by whatever path, see _IngestFileID
+	unsigned long long Inode;
+
+} IngestFile;
+
+// every trips file read so far
+struct IngestFiles
+{
+	IngestFile	*Files;
+	int			Count;
+	int			Size;
+};
+
+
+//
+// ingestion API:
+// function prototypes
+//
+IngestFiles *IngestCreate();
+void IngestSkipFile(IngestFiles *files, char *fileName);
+int IngestAppend(DivvyData *data, char *fileName, int follow, Output *out);
+void IngestPoll(DivvyData *data, Output *out);
+void IngestFree(IngestFiles *files);
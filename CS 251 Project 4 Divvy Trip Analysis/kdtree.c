@@ -0,0 +1,381 @@
+/*kdtree.c*/
+
+//
+// k-d tree spatial index over the stations, implementation file.
+//
+// The index is built once, after the stations tree, and lets "find"
+// and "route" skip every station outside the bounding box of the
+// query circle before doing any exact distance math.  Small sub-ranges
+// are tested in one go with the GeoWithin() kernel, and only the
+// stations it lets through get their exact distance.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kdtree.h"
+
+
+#define KD_PI			3.14159265
+#define KD_EARTH_RAD	3963.1		// statue miles, same as distBetween2Points
+#define KD_MARGIN		1.01		// widen the box a bit, it only has to be conservative
+#define KD_LEAF_SIZE	32			// sub-ranges this small go to GeoWithin()
+
+
+//
+// one search: the query circle, its bounding box and unit vector, and
+// what to do with every station inside it
+//
+typedef struct KDQuery
+{
+	KDBox	Box;
+	Coords	Center;
+	double	Distance;
+	double	Unit[3];		// unit vector of Center
+	double	Threshold;		// GeoThreshold(Distance)
+	void	(*Visit)(void *arg, int stationID, double distance);
+	void	*Arg;
+
+} KDQuery;
+
+
+//
+// copies the stations from the tree into the points array
+//
+static void _KDCollect(AVLNode *station, KDPoint *points, int *count) {
+
+	AVLIterator iter;
+
+	AVLIteratorInit(&iter, station, AVLInOrder);
+
+	while ((station = AVLInOrderNext(&iter)) != NULL) {
+		points[*count].Coordinates = StationValue(station)->Coordinates;
+		points[*count].StationID = station->Key;
+		*count = *count + 1;
+	}
+}
+
+
+//
+// returns the coordinate the points are split on at given axis
+//
+static double _KDAxisValue(KDPoint *point, int axis) {
+
+	if (axis == 0)
+		return point->Coordinates.latitude;
+	else
+		return point->Coordinates.longtitude;
+}
+
+
+//
+// quickselect: rearranges points[lo, hi) so the k-th one is in its
+// sorted position on the given axis, smaller ones before it and
+// larger ones after it
+//
+static void _KDSelect(KDPoint *points, int lo, int hi, int k, int axis) {
+
+	KDPoint temp;
+
+	while (hi - lo > 1) {
+		// median of the range ends and middle as the pivot
+		int mid = lo + (hi - lo) / 2;
+		double a = _KDAxisValue(&points[lo], axis);
+		double b = _KDAxisValue(&points[mid], axis);
+		double c = _KDAxisValue(&points[hi - 1], axis);
+		double pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a))
+							   : ((a < c) ? a : ((b < c) ? c : b));
+
+		// three-way partition: [lo, lt) < pivot, [lt, gt) == pivot, [gt, hi) > pivot
+		int lt = lo, i = lo, gt = hi;
+		while (i < gt) {
+			double v = _KDAxisValue(&points[i], axis);
+			if (v < pivot) {
+				temp = points[lt]; points[lt] = points[i]; points[i] = temp;
+				lt++;
+				i++;
+			}
+			else if (v > pivot) {
+				gt--;
+				temp = points[gt]; points[gt] = points[i]; points[i] = temp;
+			}
+			else
+				i++;
+		}
+
+		// continue in the part holding k
+		if (k < lt)
+			hi = lt;
+		else if (k >= gt)
+			lo = gt;
+		else
+			return;
+	}
+}
+
+
+//
+// recursively builds the implicit tree over points[lo, hi)
+//
+static void _KDBuild(KDPoint *points, int lo, int hi, int axis) {
+
+	// base case
+	if (hi - lo <= 1)
+		return;
+
+	int mid = lo + (hi - lo) / 2;
+	_KDSelect(points, lo, hi, mid, axis);
+
+	_KDBuild(points, lo, mid, 1 - axis);
+	_KDBuild(points, mid + 1, hi, 1 - axis);
+}
+
+
+//
+// KDBuild:
+//
+// Builds the spatial index over all stations in the given tree.
+//
+KDTree *KDBuild(StationTree *stations) {
+
+	KDTree *tree = (KDTree*)malloc(sizeof(KDTree));
+	int count = 0;
+
+	tree->Points = (KDPoint*)malloc(sizeof(KDPoint) * (AVLCount(&stations->Base) + 1));
+	_KDCollect(stations->Base.Root, tree->Points, &count);
+	tree->Count = count;
+
+	_KDBuild(tree->Points, 0, tree->Count, 0);
+
+	// unit vectors, in the final order of the points
+	tree->Vectors = GeoVectorsCreate(tree->Count);
+	for (count = 0; count < tree->Count; count++)
+		GeoVectorsSet(tree->Vectors, count, tree->Points[count].Coordinates.latitude,
+			tree->Points[count].Coordinates.longtitude);
+
+	return tree;
+}
+
+
+//
+// KDBoundingBox:
+//
+// Returns a latitude / longtitude box that contains every point within
+// the given distance (miles) of center.  Latitude can't change faster
+// than the distance travelled, longtitude changes at most 1/cos(lat)
+// times faster at the highest latitude the circle reaches.
+//
+KDBox KDBoundingBox(Coords center, double distance) {
+
+	KDBox box;
+	double dLat = (distance / KD_EARTH_RAD) * 180.0 / KD_PI * KD_MARGIN;
+	double maxAbsLat = fabs(center.latitude) + dLat;
+
+	box.minLatitude = center.latitude - dLat;
+	box.maxLatitude = center.latitude + dLat;
+
+	if (maxAbsLat >= 89.0 || dLat >= 45.0) {
+		// circle gets near a pole or is huge, any longtitude could match
+		box.minLongtitude = -HUGE_VAL;
+		box.maxLongtitude = HUGE_VAL;
+	}
+	else {
+		double dLong = dLat / cos(maxAbsLat * KD_PI / 180.0);
+
+		box.minLongtitude = center.longtitude - dLong;
+		box.maxLongtitude = center.longtitude + dLong;
+
+		// crossing the date line, don't bother wrapping around
+		if (box.minLongtitude < -180.0 || box.maxLongtitude > 180.0) {
+			box.minLongtitude = -HUGE_VAL;
+			box.maxLongtitude = HUGE_VAL;
+		}
+	}
+
+	return box;
+}
+
+
+//
+// returns TRUE if the point lies inside the box
+//
+static int _KDInBox(KDPoint *point, KDBox *box) {
+
+	return point->Coordinates.latitude >= box->minLatitude
+		&& point->Coordinates.latitude <= box->maxLatitude
+		&& point->Coordinates.longtitude >= box->minLongtitude
+		&& point->Coordinates.longtitude <= box->maxLongtitude;
+}
+
+
+//
+// computes the exact distance of the point, and calls visit() if it is
+// within range
+//
+static void _KDVisit(KDPoint *point, KDQuery *query) {
+
+	double actualDistance = distBetween2Points(point->Coordinates.latitude,
+		point->Coordinates.longtitude, query->Center.latitude, query->Center.longtitude);
+
+	if (actualDistance <= query->Distance)
+		query->Visit(query->Arg, point->StationID, actualDistance);
+}
+
+
+//
+// walks points[lo, hi) in the same order as _KDSearch, visiting those
+// GeoWithin() let through; mask[i - base] is the flag of point i
+//
+static void _KDSearchMasked(KDTree *tree, int lo, int hi, int base,
+	const unsigned char *mask, KDQuery *query) {
+
+	// base case
+	if (lo >= hi)
+		return;
+
+	int mid = lo + (hi - lo) / 2;
+
+	if (mask[mid - base])
+		_KDVisit(&tree->Points[mid], query);
+
+	_KDSearchMasked(tree, lo, mid, base, mask, query);
+	_KDSearchMasked(tree, mid + 1, hi, base, mask, query);
+}
+
+
+//
+// visits every point of points[lo, hi) inside the box, calls visit()
+// with the exact distance for each one that is within range
+//
+static void _KDSearch(KDTree *tree, int lo, int hi, int axis, KDQuery *query) {
+
+	// base case
+	if (lo >= hi)
+		return;
+
+	// small enough, test the whole range at once
+	if (hi - lo <= KD_LEAF_SIZE) {
+		unsigned char mask[KD_LEAF_SIZE];
+
+		GeoWithin(tree->Vectors, lo, hi, query->Unit, query->Threshold, mask);
+		_KDSearchMasked(tree, lo, hi, lo, mask, query);
+		return;
+	}
+
+	int mid = lo + (hi - lo) / 2;
+	KDPoint *point = &tree->Points[mid];
+	double value = _KDAxisValue(point, axis);
+	double min = (axis == 0) ? query->Box.minLatitude : query->Box.minLongtitude;
+	double max = (axis == 0) ? query->Box.maxLatitude : query->Box.maxLongtitude;
+
+	// check the splitting point itself
+	if (_KDInBox(point, &query->Box))
+		_KDVisit(point, query);
+
+	// visit left part if the box reaches below the split
+	if (min <= value)
+		_KDSearch(tree, lo, mid, 1 - axis, query);
+
+	// visit right part if the box reaches above the split
+	if (max >= value)
+		_KDSearch(tree, mid + 1, hi, 1 - axis, query);
+}
+
+
+//
+// sets up the query and runs the search from the root
+//
+static void _KDQuery(KDTree *tree, Coords center, double distance,
+	void(*visit)(void *arg, int stationID, double distance), void *arg) {
+
+	KDQuery query;
+
+	query.Box = KDBoundingBox(center, distance);
+	query.Center = center;
+	query.Distance = distance;
+	GeoUnitVector(center.latitude, center.longtitude, query.Unit);
+	query.Threshold = GeoThreshold(distance);
+	query.Visit = visit;
+	query.Arg = arg;
+
+	_KDSearch(tree, 0, tree->Count, 0, &query);
+}
+
+
+//
+// adds station into closest stations array
+//
+static void _KDAddClosestStation(void *arg, int stationID, double distance) {
+
+	ClosestStations *closestStations = (ClosestStations*)arg;
+
+	// update count
+	closestStations->count++;
+	// grow size if needed
+	if (closestStations->count > closestStations->size)
+		GrowClosestStations(closestStations);
+
+	// add to array
+	closestStations->stations[closestStations->count - 1].distance = distance;
+	closestStations->stations[closestStations->count - 1].stationID = stationID;
+}
+
+
+//
+// adds station id into the list, the distance doesn't matter
+//
+static void _KDAddID(void *arg, int stationID, double distance) {
+
+	(void)distance;
+	AddToIDList((IDList*)arg, stationID);
+}
+
+
+//
+// KDFindClosestStations:
+//
+// Same as AVLFindClosestStations, but only stations inside the bounding
+// box of the query circle have their distance computed, and small
+// sub-ranges are pre-filtered by GeoWithin().
+//
+ClosestStations *KDFindClosestStations(KDTree *tree, Coords userLocation,
+	double distance, ClosestStations *closestStations) {
+
+	_KDQuery(tree, userLocation, distance, _KDAddClosestStation, closestStations);
+
+	return closestStations;
+}
+
+
+//
+// KDBuildSubSet:
+//
+// Adds the ids of the stations within distance of coords to list,
+// pruned by the bounding box like KDFindClosestStations.
+//
+void KDBuildSubSet(KDTree *tree, IDList *list, Coords coords, double distance) {
+
+	_KDQuery(tree, coords, distance, _KDAddID, list);
+}
+
+
+//
+// KDFree:
+//
+// Frees the index.
+//
+void KDFree(KDTree *tree) {
+
+	GeoVectorsFree(tree->Vectors);
+	free(tree->Points);
+	free(tree);
+}
@@ -0,0 +1,61 @@
+/*kdtree.h*/
+
+//
+// k-d tree spatial index over the stations, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "avl.h"
+#include "geo.h"
+
+
+//
+// k-d tree type declarations:
+//
+
+// one station in the index
+typedef struct KDPoint
+{
+	Coords	Coordinates;
+	int		StationID;
+
+} KDPoint;
+
+// latitude / longitude bounding box of a query
+typedef struct KDBox
+{
+	double	minLatitude;
+	double	maxLatitude;
+	double	minLongtitude;
+	double	maxLongtitude;
+
+} KDBox;
+
+// implicit 2-d tree: the point in the middle of every sub-range
+// [lo, hi) splits it, on latitude at even depths and on longtitude
+// at odd depths; Vectors[i] is the unit vector of Points[i]
+typedef struct KDTree
+{
+	KDPoint		*Points;
+	GeoVectors	*Vectors;
+	int			Count;
+
+} KDTree;
+
+
+//
+// k-d tree API:
+// function prototypes
+//
+KDTree *KDBuild(StationTree *stations);
+KDBox KDBoundingBox(Coords center, double distance);
+ClosestStations *KDFindClosestStations(KDTree *tree, Coords userLocation,
+	double distance, ClosestStations *closestStations);
+void KDBuildSubSet(KDTree *tree, IDList *list, Coords coords, double distance);
+void KDFree(KDTree *tree);
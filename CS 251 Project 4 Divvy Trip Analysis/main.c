@@ -18,14 +18,27 @@
 #include <assert.h>
 #include <math.h>
 #include "avl.h"
+#include "kdtree.h"
+#include "routes.h"
+#include "thread.h"
+#include "cavl.h"
+#include "idtable.h"
+#include "timer.h"
+#include "csv.h"
+#include "snapshot.h"
+#include "triptable.h"
+#include "output.h"
+#include "query.h"
+#include "bench.h"
+#include "ingest.h"
 
 
 // ----------------------------------------------------------------------------
 // Functions Declarations
 // ----------------------------------------------------------------------------
 double distBetween2Points(double lat1, double long1, double lat2, double long2);
-void freeAVLNodeData(AVLKey key, AVLValue value);
 char *getFileName(); 
+char *copyFileName(char *filename);
 void skipRestOfInput(FILE *stream);
 
 
@@ -35,167 +48,227 @@ void skipRestOfInput(FILE *stream);
 //
 // main:
 //
-int main()
+int main(int argc, char *argv[])
 {
-	int id = 0;				// user input 
-	double distance = 0;	// user distance
+	int threads = 1;		// # of threads used to load the trips, and run batch queries
+	int useSnapshot = TRUE;	// load from the binary snapshot, if up to date
+	int saveSnapshot = FALSE;	// save one after loading the CSV files
+	char *batchFiles[3] = { NULL, NULL, NULL };	// stations, trips and queries
+	char *generateFiles[2] = { NULL, NULL };		// stations and trips to write
+	char *benchFiles[2] = { NULL, NULL };			// stations and trips to load
+	int stressCount = 0;					// # of keys to insert in --stress
+	int stationCount = 0;					// # of stations to generate
+	long long tripCount = 0;				// # of trips to generate
+	unsigned long long seed = 1;			// of the generator
+	int i;
 
-	printf("** Welcome to Divvy Route Analysis **\n");
+	//
+	// command line options:
+	//   --threads N     load the trips, and run batch queries, with N
+	//                   threads, 0 => one per core
+	//   --snapshot      after loading the CSV files, save them to the
+	//                   binary snapshot, <trips>.snap, for next time
+	//   --no-snapshot   always load the CSV files, don't write a snapshot
+	//   --batch S T Q   load stations file S and trips file T, run the
+	//                   queries of file Q and write only their results
+	//   --generate S T NS NT
+	//                   write NS synthetic stations to S and NT trips to T
+	//   --seed N        seed of --generate and --stress, same seed =>
+	//                   same files
+	//   --bench S T     load S and T phase by phase, and time lookups
+	//   --stress N      insert N keys into a tree on one thread, while
+	//                   the other threads (at least 1) read and check it
+	//
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+			if (threads <= 0)
+				threads = ThreadHardwareCount();
+		}
+		else if (strcmp(argv[i], "--snapshot") == 0) {
+			saveSnapshot = TRUE;
+		}
+		else if (strcmp(argv[i], "--no-snapshot") == 0) {
+			useSnapshot = FALSE;
+		}
+		else if (strcmp(argv[i], "--batch") == 0 && i + 3 < argc) {
+			batchFiles[0] = argv[++i];
+			batchFiles[1] = argv[++i];
+			batchFiles[2] = argv[++i];
+		}
+		else if (strcmp(argv[i], "--generate") == 0 && i + 4 < argc) {
+			generateFiles[0] = argv[++i];
+			generateFiles[1] = argv[++i];
+			stationCount = atoi(argv[++i]);
+			tripCount = atoll(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--bench") == 0 && i + 2 < argc) {
+			benchFiles[0] = argv[++i];
+			benchFiles[1] = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc) {
+			stressCount = atoi(argv[++i]);
+		}
+		else {
+			printf("**Error: unknown option '%s'\n", argv[i]);
+			printf("usage: %s [--threads N] [--snapshot | --no-snapshot] [--batch stations trips queries]\n"
+				"       %s --generate stations trips #stations #trips [--seed N]\n"
+				"       %s --bench stations trips [--threads N] [--snapshot]\n"
+				"       %s --stress #keys [--threads N] [--seed N]\n\n", argv[0], argv[0], argv[0],
+				argv[0]);
+			exit(-1);
+		}
+	}
 
 	//
-	// get filenames from the user/stdin:
+	// benchmark modes, no queries:
 	//
-	char  cmd[64];
-	char *StationsFileName = getFileName();
-	char *TripsFileName = getFileName();
+	if (generateFiles[0] != NULL) {
+		if (!BenchGenerate(generateFiles[0], generateFiles[1], stationCount, tripCount, seed)) {
+			printf("**Error: unable to generate '%s', '%s'\n\n", generateFiles[0], generateFiles[1]);
+			exit(-1);
+		}
+		return 0;
+	}
+
+	if (benchFiles[0] != NULL) {
+		char *StationsFileName = copyFileName(benchFiles[0]);
+		char *TripsFileName = copyFileName(benchFiles[1]);
+		int ok = BenchRun(StationsFileName, TripsFileName, threads, saveSnapshot);
+
+		free(StationsFileName);
+		free(TripsFileName);
+		return ok ? 0 : -1;
+	}
+
+	if (stressCount > 0)
+		return BenchStress(threads, stressCount, seed) ? 0 : -1;
+
+	int batch = (batchFiles[0] != NULL);
+
+	if (!batch)
+		printf("** Welcome to Divvy Route Analysis **\n");
+
+	//
+	// get filenames from the command line, or the user/stdin:
+	//
+	char *StationsFileName = batch ? copyFileName(batchFiles[0]) : getFileName();
+	char *TripsFileName = batch ? copyFileName(batchFiles[1]) : getFileName();
 
 	//
 	// Create trees
-	AVL *stations = AVLCreate();
-	AVL *trips = AVLCreate();
-	AVL *bikes = AVLCreate();
+	DivvyData data;
+	data.Stations = StationTreeCreate();
+	data.Trips = TripTableCreate();
+	data.Bikes = BikeTreeCreate();
+	data.Routes = RouteMatrixCreate();
 
 
 	//
-	// Build trees
+	// Build trees, from the snapshot of the CSV files if there is an
+	// up to date one, else from the files -- and then save a snapshot
+	// if asked to
 	//
-	AVLBuildStationsTree(stations, StationsFileName);
-	AVLBuildTripsTree(trips, bikes, TripsFileName);
-	AVLUpdateStationsTree(stations, trips->Root);
-	
-	
+	char *stationNames = NULL;
+	char *snapshotFileName = (char*)malloc(strlen(TripsFileName) + strlen(SNAPSHOT_SUFFIX) + 1);
+	strcpy(snapshotFileName, TripsFileName);
+	strcat(snapshotFileName, SNAPSHOT_SUFFIX);
+
+	if (!useSnapshot || !SnapshotLoad(snapshotFileName, StationsFileName, TripsFileName,
+		data.Stations, data.Trips, data.Bikes, data.Routes, &data.BikeTrips, &data.TripsByTime,
+		&stationNames)) {
+		double loadStart = TimerNow();
+
+		stationNames = AVLBuildStationsTree(data.Stations, StationsFileName);
+		AVLBuildTripsTree(data.Trips, data.Bikes, data.Stations, data.Routes, &data.BikeTrips,
+			TripsFileName, threads);
+		AVLBuildTimeIndex(data.Trips, &data.TripsByTime);
+
+		if (useSnapshot && saveSnapshot && !SnapshotSave(snapshotFileName, StationsFileName, TripsFileName,
+			data.Stations, data.Trips, data.Bikes, data.Routes, &data.BikeTrips, &data.TripsByTime,
+			stationNames, TimerNow() - loadStart))
+			fprintf(stderr, "** Unable to write snapshot '%s'\n", snapshotFileName);
+	}
+
 	//
-	// now interact with user:
+	// Build spatial index over the stations
 	//
-	printf("** Ready **\n");
+	data.StationIndex = KDBuild(data.Stations);
 
-	scanf("%s", cmd);
+	//
+	// Direct-mapped station and bike lookup, if their IDs are dense
+	// enough (NULL otherwise, and lookups go to the trees)
+	//
+	data.StationTable = IDTableBuild(&data.Stations->Base);
+	data.BikeTable = IDTableBuild(&data.Bikes->Base);
 
-	while (strcmp(cmd, "exit") != 0)
-	{
-		if (strcmp(cmd, "stats") == 0)
-		{
-			//
-			// Output some stats about our data structures:
-			//
-			printf("** Trees:\n");
-
-			printf("   Stations: count = %d, height = %d\n",
-				AVLCount(stations), AVLHeight(stations));
-			printf("   Trips:    count = %d, height = %d\n",
-				AVLCount(trips), AVLHeight(trips));
-			printf("   Bikes:    count = %d, height = %d\n",
-				AVLCount(bikes), AVLHeight(bikes));
-		}
-		else if (strcmp(cmd, "station") == 0) 
-		{	
-			scanf("%d", &id);
-			// display info about station
-			DisplayStationInfo(AVLSearch(stations, id));
-		}
-		else if (strcmp(cmd, "trip") == 0)
-		{
-			// display info about trip
-			scanf("%d", &id);
-			DisplayTripInfo(AVLSearch(trips, id));
-		}
-		else if (strcmp(cmd, "bike") == 0)
-		{
-			// display info about bike
-			scanf("%d", &id);
-			DisplayBikeInfo(AVLSearch(bikes, id));
-		}
-		else if (strcmp(cmd, "find") == 0)
-		{
-			// array to hold set of locations
-			ClosestStations *closestStations = (ClosestStations*)malloc(sizeof(ClosestStations));
-			Coords userLocation;	// user coordinates
-			// initialize the array info
-			InitializeClosestStations(closestStations);
-			scanf("%lf %lf %lf", &userLocation.latitude, &userLocation.longtitude, &distance);
-			// traverse the tree and insert stations into array
-			closestStations = AVLFindClosestStations(stations->Root, userLocation, distance, closestStations);
-			// sort the array by distance, secondary by id
-			SelectionSort(closestStations);
-			// display closest stations
-			DisplayClosestStations(closestStations);
-
-			// free the memory
-			free(closestStations->stations);
-			free(closestStations);
-		}
-		else if (strcmp(cmd, "route") == 0)
-		{	
-			// declare needed variables
-			int tripCount = 0;						// number of trips
-			AVLNode *sourceNode;					// source station
-			AVLNode *destNode;						// destunation station 
-			Coords sourceCoords, destCoords;		// coordinates of the stations
-			IDList *sources;						// set of source stations
-			IDList *destinations;					// set of destination stations
-			AVLNode *trip;							// trip node based on id
-
-			// initialize arrays
-			sources = InitializeIDList();
-			destinations = InitializeIDList();
-			
-			scanf("%d %lf", &id, &distance); 
-			// grab the info about given trip
-			trip = AVLSearch(trips, id);
-
-			if (trip == NULL) {		// not found
-				printf("**not found\n");
-				scanf("%s", cmd);
-				continue;
-			}
-
-			// store info from trip node into source and destination ID's
-			int sourceID = trip->Value.Trip.FromID;
-			int destID = trip->Value.Trip.ToID;
-
-			// find the nodes
-			sourceNode = AVLSearch(stations, sourceID);
-			destNode = AVLSearch(stations, destID);
-
-			// assign coords
-			sourceCoords = sourceNode->Value.Station.Coordinates;
-			destCoords = destNode->Value.Station.Coordinates;
-
-			// build sources and destination Subsets
-			AVLBuildSubSet(sources, sourceCoords, stations->Root, distance);
-			AVLBuildSubSet(destinations, destCoords, stations->Root, distance);			// count trips
-			AVLCountTrips(sources, destinations, trips->Root, &tripCount);
-			DisplayRouteStats(tripCount, sourceID, destID, trips->Count);
-
-			// free the memory
-			free(sources->arr);
-			free(sources);
-			free(destinations->arr);
-			free(destinations);
+	//
+	// append and follow only read what is added to the trips file from
+	// now on
+	//
+	data.Files = IngestCreate();
+	IngestSkipFile(data.Files, TripsFileName);
+
+
+	if (batch) {
+		//
+		// run the query file:
+		//
+		if (!RunBatch(&data, batchFiles[2], threads, stdout)) {
+			printf("**Error: unable to open '%s'\n\n", batchFiles[2]);
+			exit(-1);
 		}
-		else
+	}
+	else {
+		//
+		// now interact with user:
+		//
+		Query query;
+		Output out;
+
+		OutputInit(&out, stdout);
+		printf("** Ready **\n");
+
+		while (ReadQuery(stdin, &query) && query.Type != QueryExit)
 		{
-			printf("**unknown cmd, try again...\n");
+			IngestPoll(&data, &out);		// new rows of followed files first
+			ExecuteQuery(&data, &query, &out);
+			OutputFlush(&out);
+			QueryFree(&query);
 		}
 
-		scanf("%s", cmd);
+		OutputFree(&out);
 	}
 
 	//
 	// done, free memory and return:
 	//
-	printf("** Freeing memory **\n");
+	if (!batch)
+		printf("** Freeing memory **\n");
 
 	// free the memory used for tree
-	AVLFree(stations, freeAVLNodeData);
-	AVLFree(trips, freeAVLNodeData);
-	AVLFree(bikes, freeAVLNodeData);
+	StationTreeFree(data.Stations);		// names are freed all at once, below
+	TripTableFree(data.Trips);
+	BikeTreeFree(data.Bikes);
+	KDFree(data.StationIndex);
+	IDTableFree(data.StationTable);
+	IDTableFree(data.BikeTable);
+	RouteMatrixFree(data.Routes);
+	free(data.BikeTrips.Rows);
+	free(data.TripsByTime.Rows);
+	IngestFree(data.Files);
 	
-	// free the memory used for filenames
+	// free the memory used for station names and filenames
+	free(stationNames);
 	free(StationsFileName);
 	free(TripsFileName);
+	free(snapshotFileName);
 
-	printf("** Done **\n");
+	if (!batch)
+		printf("** Done **\n");
 
 	return 0;
 } // end of main
@@ -236,36 +309,6 @@ double distBetween2Points(double lat1, double long1, double lat2, double long2)
 }
 
 
-//
-// freeAVLNodeData
-//
-// Works with AVLFree() to free the data inside (key, value) pairs.
-//
-void freeAVLNodeData(AVLKey key, AVLValue value)
-{
-	//
-	// what we free depends on what type of value we have:
-	//
-	if (value.Type == STATIONTYPE)
-	{
-		free(value.Station.Name);
-	}
-	else if (value.Type == TRIPTYPE)
-	{
-		return;
-	}
-	else if (value.Type == BIKETYPE)
-	{
-		return;
-	}
-	else
-	{
-		printf("**ERROR: unexpected value type in freeAVLNodeData!\n\n");
-		exit(-1);
-	}
-}
-
-
 //
 // getFileName: 
 //
@@ -282,7 +325,20 @@ char *getFileName()
 	fgets(filename, fnsize, stdin);
 	filename[strcspn(filename, "\r\n")] = '\0';  // strip EOL char(s):
 
-												 // make sure filename exists and can be opened:
+	return copyFileName(filename);
+}
+
+
+//
+// copyFileName: 
+//
+// Makes sure the file can be opened, and returns a copy of the
+// filename if so.  If the file cannot be opened, an error message is
+// output and the program is exited.
+//
+char *copyFileName(char *filename)
+{
+	// make sure filename exists and can be opened:
 	FILE *infile = fopen(filename, "r");
 	if (infile == NULL)
 	{
@@ -349,43 +405,95 @@ void GrowClosestStations(ClosestStations *closestStations) {
 
 
 //
-// selection sort 
+// orders stations by distance, secondary by id
 //
-void SelectionSort(ClosestStations *closestStations) {
-	int i = 0;					// outer loop counter
-	int j = 0;					// inner loop counter
-	int minIndex = 0;			// stores index of minimum value during selection sort
+int CompareStationInfo(const void *a, const void *b) {
+
+	const StationInfo *s1 = (const StationInfo*)a;
+	const StationInfo *s2 = (const StationInfo*)b;
+
+	if (s1->distance < s2->distance)
+		return -1;
+	else if (s1->distance > s2->distance)
+		return 1;
+	else if (s1->stationID < s2->stationID)
+		return -1;
+	else if (s1->stationID > s2->stationID)
+		return 1;
+	else
+		return 0;
+}
+
+
+//
+// sorts the array by distance, secondary by id; station ids are unique,
+// so the order is total and the same whatever sort algorithm is used
+//
+void SortClosestStations(ClosestStations *closestStations) {
+
+	qsort(closestStations->stations, closestStations->count, sizeof(StationInfo),
+		CompareStationInfo);
+}
+
+
+//
+// restores the max-heap property of heap[0, count) below index i
+//
+static void _SiftDown(StationInfo *heap, int count, int i) {
+
 	StationInfo temp;
 
-	for (i = 0; i < closestStations->count; i++) {
-		minIndex = i;			// assign current i for minIndex
-		for (j = i + 1; j < closestStations->count; j++) {
-			if (closestStations->stations[j].distance < closestStations->stations[minIndex].distance) {
-				minIndex = j;	// new minIndex found, assign to minIndex
-			}
-		}
+	for (;;) {
+		int largest = i;
+		int left = 2 * i + 1;
+		int right = 2 * i + 2;
+
+		if (left < count && CompareStationInfo(&heap[left], &heap[largest]) > 0)
+			largest = left;
+		if (right < count && CompareStationInfo(&heap[right], &heap[largest]) > 0)
+			largest = right;
+
+		if (largest == i)
+			return;
 
-		// swap the elements in the array
-		temp = closestStations->stations[i];	// store stations[i] into temp
-
-		// store minIndex station into i-th position
-		closestStations->stations[i] = closestStations->stations[minIndex];
-		// copy temp into minIndex station
-		closestStations->stations[minIndex] = temp;
-
-		// sort by id if distance is the same
-		if (i > 0) {
-			if (closestStations->stations[i - 1].distance
-				== closestStations->stations[i].distance)
-				if (closestStations->stations[i - 1].stationID
-				> closestStations->stations[i].stationID) {
-					// swap
-					temp = closestStations->stations[i - 1];
-					closestStations->stations[i - 1] = closestStations->stations[i];
-					closestStations->stations[i] = temp;
-				}
+		// swap with the larger child and continue there
+		temp = heap[i];
+		heap[i] = heap[largest];
+		heap[largest] = temp;
+		i = largest;
+	}
+}
+
+
+//
+// keeps only the k closest stations, sorted by distance, secondary by
+// id.  The first k entries are used as a max-heap of the best ones
+// seen so far, so this is O(n log k) instead of sorting all n.
+//
+void KeepClosestStations(ClosestStations *closestStations, int k) {
+
+	StationInfo *heap = closestStations->stations;
+	int i;
+
+	if (k < 0 || k >= closestStations->count) {		// nothing to drop
+		SortClosestStations(closestStations);
+		return;
+	}
+
+	// heapify the first k
+	for (i = k / 2 - 1; i >= 0; i--)
+		_SiftDown(heap, k, i);
+
+	// anything closer than the farthest kept one replaces it
+	for (i = k; i < closestStations->count; i++) {
+		if (k > 0 && CompareStationInfo(&heap[i], &heap[0]) < 0) {
+			heap[0] = heap[i];
+			_SiftDown(heap, k, 0);
 		}
 	}
+
+	closestStations->count = k;
+	SortClosestStations(closestStations);
 }
 
 
@@ -400,6 +508,10 @@ IDList *InitializeIDList() {
 	list->count = 0;
 	list->size = 5;
 
+	// 16 empty slots in the set
+	list->setSize = 16;
+	list->set = (int*)calloc(list->setSize, sizeof(int));
+
 	return list;		// return pointer to the new list
 }
 
@@ -427,89 +539,279 @@ void GrowIDList(IDList *list) {
 
 
 //
-// searches if given integer is in the array 
+// returns the slot of id in the set, or the empty slot where it goes
+//
+static int _FindIDSlot(IDList *list, int id) {
+
+	unsigned int mask = (unsigned int)(list->setSize - 1);
+	unsigned int i = ((unsigned int)id * 0x9E3779B1u) & mask;
+
+	// linear probing, a slot is the index of its id + 1
+	while (list->set[i] != 0 && list->arr[list->set[i] - 1] != id)
+		i = (i + 1) & mask;
+
+	return (int)i;
+}
+
+
+//
+// adds id to the list, and to its set; id's already in it are ignored
+//
+void AddToIDList(IDList *list, int id) {
+	int i;
+
+	int slot = _FindIDSlot(list, id);
+	if (list->set[slot] != 0)		// already there
+		return;
+
+	list->count++;					// increment count
+	if (list->count > list->size)	// size too small, increase size
+		GrowIDList(list);
+
+	// insert into array, and its index into the set
+	list->arr[list->count - 1] = id;
+	list->set[slot] = list->count;
+
+	// keep the set at most half full, rehash the array into a bigger one
+	if (list->count * 2 > list->setSize) {
+		free(list->set);
+		list->setSize *= 2;
+		list->set = (int*)calloc(list->setSize, sizeof(int));
+		for (i = 0; i < list->count; i++)
+			list->set[_FindIDSlot(list, list->arr[i])] = i + 1;
+	}
+}
+
+
+//
+// searches if given integer is in the list, O(1) using its set
 //
 int SearchArray(IDList *sources, int id) {
 	
-	int i = 0;	// loop counter
-	
-	for (; i < sources->count; i++) {
-		if (sources->arr[i] == id)
-			return TRUE;	// found
-	}
+	if (sources->set[_FindIDSlot(sources, id)] != 0)
+		return TRUE;	// found
 
 	return FALSE;			// not found
 }
 
 
+//
+// frees the list
+//
+void FreeIDList(IDList *list) {
+
+	free(list->arr);
+	free(list->set);
+	free(list);
+}
+
+
 //
 // Displays the info about station
 //
-void DisplayStationInfo(AVLNode *station) {
+void DisplayStationInfo(Output *out, AVLNode *station) {
 
 	// empty
 	if (station == NULL) {
-		printf("**not found\n");
+		OutputPrintf(out, "**not found\n");
 		return;
 	}
 
 	// displays stats
-	printf("**Station %d:\n", station->Key);
-	printf("  Name: \'%s\'\n", station->Value.Station.Name);
-	printf("%-13s (%lf,%lf)\n", "  Location:", station->Value.Station.Coordinates.latitude,
-		station->Value.Station.Coordinates.longtitude);
-	printf("%-13s %d\n", "  Capacity:", station->Value.Station.Capacity);
-	printf("  Trip count: %d\n", station->Value.Station.TripCount);
+	OutputPrintf(out, "**Station %d:\n", station->Key);
+	OutputPrintf(out, "  Name: \'%s\'\n", StationValue(station)->Name);
+	OutputPrintf(out, "%-13s (%lf,%lf)\n", "  Location:", StationValue(station)->Coordinates.latitude,
+		StationValue(station)->Coordinates.longtitude);
+	OutputPrintf(out, "%-13s %d\n", "  Capacity:", StationValue(station)->Capacity);
+	OutputPrintf(out, "  Trip count: %d\n", StationValue(station)->TripCount);
 }
 
 
 //
 // Displays the info about trip
 //
-void DisplayTripInfo(AVLNode *trip) {
+void DisplayTripInfo(Output *out, TripTable *trips, int row) {
 
 	// empty
-	if (trip == NULL) {
-		printf("**not found\n");
+	if (row < 0) {
+		OutputPrintf(out, "**not found\n");
 		return;
 	}
 
+	TRIP trip = TripTableGet(trips, row);
+
 	// displays stats
-	printf("**Trip %d:\n", trip->Key);
-	printf("%-7s %d\n", "  Bike:", trip->Value.Trip.BikeID);
-	printf("%-7s %d\n", "  From:", trip->Value.Trip.FromID);
-	printf("%-7s %d\n", "  To:", trip->Value.Trip.ToID);
-	printf("  Duration: %d min, %d secs\n", trip->Value.Trip.TripDuration.minutes,
-		trip->Value.Trip.TripDuration.seconds);
+	OutputPrintf(out, "**Trip %d:\n", trips->TripID[row]);
+	OutputPrintf(out, "%-7s %d\n", "  Bike:", trip.BikeID);
+	OutputPrintf(out, "%-7s %d\n", "  From:", trip.FromID);
+	OutputPrintf(out, "%-7s %d\n", "  To:", trip.ToID);
+	OutputPrintf(out, "  Duration: %d min, %d secs\n", trip.TripDuration.minutes,
+		trip.TripDuration.seconds);
+}
+
+
+//
+// Displays the info about trip on one line
+//
+void DisplayTripLine(Output *out, TripTable *trips, int row) {
+
+	TRIP trip = TripTableGet(trips, row);
+
+	OutputPrintf(out, "Trip %d: bike %d, from %d to %d, %d min %d secs\n", trips->TripID[row],
+		trip.BikeID, trip.FromID, trip.ToID,
+		trip.TripDuration.minutes, trip.TripDuration.seconds);
+}
+
+
+//
+// returns the tree called name, NULL if there is no such tree -- the
+// trips are in a table, not a tree
+//
+AVL *SelectTree(char *name, StationTree *stations, BikeTree *bikes) {
+
+	if (strcmp(name, "stations") == 0)
+		return &stations->Base;
+	else if (strcmp(name, "bikes") == 0)
+		return &bikes->Base;
+	else
+		return NULL;
+}
+
+
+//
+// Displays the rank of id among count ids
+//
+void DisplayRank(Output *out, char *name, int id, int rank, int count) {
+
+	OutputPrintf(out, "** Rank: %d of %d %s have id < %d (%lf%%)\n", rank, count,
+		name, id, count == 0 ? 0.0 : ((double)rank / count) * 100);
+}
+
+
+//
+// reads an optional "YYYY-MM-DD YYYY-MM-DD" (or M/D/YYYY) date range from
+// the rest of the input line; returns TRUE and the window [from, to),
+// from the start of the first day to the end of the last one, if there
+// is one
+//
+int ReadTimeWindow(FILE *input, long long *from, long long *to) {
+
+	char restOfLine[256];
+	char first[64], last[64];
+	CSVField field;
+
+	if (fgets(restOfLine, sizeof(restOfLine), input) == NULL)
+		return FALSE;
+	if (sscanf(restOfLine, "%63s %63s", first, last) != 2)
+		return FALSE;
+
+	field.Start = first;
+	field.Length = (int)strlen(first);
+	field.Quoted = FALSE;
+	*from = CSVParseDateTime(&field);
+
+	field.Start = last;
+	field.Length = (int)strlen(last);
+	*to = CSVParseDateTime(&field);
+
+	if (*from < 0 || *to < 0)
+		return FALSE;
+
+	*to += 24 * 60 * 60;		// up to the end of the last day
+	return TRUE;
+}
+
+
+//
+// counts the trips starting in [from, to) from any station in sources
+// to any station in destinations, and all trips in the window
+//
+int CountRouteTrips(TripTable *trips, TripList *byTime, long long from, long long to,
+	IDList *sources, IDList *destinations, int *windowTrips) {
+
+	int first = AVLTimeIndexFirst(trips, byTime, from);
+	int last = AVLTimeIndexFirst(trips, byTime, to);
+	int count = 0;
+	int i;
+
+	for (i = first; i < last; i++) {
+		int row = byTime->Rows[i];
+		if (SearchArray(sources, trips->FromID[row]) && SearchArray(destinations, trips->ToID[row]))
+			count++;
+	}
+
+	*windowTrips = (last > first) ? last - first : 0;
+	return count;
+}
+
+
+//
+// counts the trips starting in [from, to) to or from the station, a
+// trip from the station back to it counts twice, like its trip count
+//
+int CountStationTrips(TripTable *trips, TripList *byTime, long long from, long long to,
+	int stationID) {
+
+	int first = AVLTimeIndexFirst(trips, byTime, from);
+	int last = AVLTimeIndexFirst(trips, byTime, to);
+	int count = 0;
+	int i;
+
+	for (i = first; i < last; i++) {
+		int row = byTime->Rows[i];
+		count += (trips->FromID[row] == stationID) + (trips->ToID[row] == stationID);
+	}
+
+	return count;
+}
+
+
+//
+// Displays the trips of the bike, one line each
+//
+void DisplayBikeTrips(Output *out, AVLNode *bike, TripList *bikeTrips, TripTable *trips) {
+
+	int i;
+
+	// empty
+	if (bike == NULL) {
+		OutputPrintf(out, "**not found\n");
+		return;
+	}
+
+	OutputPrintf(out, "**Bike %d:\n", bike->Key);
+	for (i = 0; i < BikeValue(bike)->ListCount; i++)
+		DisplayTripLine(out, trips, bikeTrips->Rows[BikeValue(bike)->FirstTrip + i]);
+	OutputPrintf(out, "  Trip count: %d\n", BikeValue(bike)->ListCount);
 }
 
 
 //
 // Displays the info about bike
 //
-void DisplayBikeInfo(AVLNode *bike) {
+void DisplayBikeInfo(Output *out, AVLNode *bike) {
 
 	// empty
 	if (bike == NULL) {
-		printf("**not found\n");
+		OutputPrintf(out, "**not found\n");
 		return;
 	}
 
 	// displays stats
-	printf("**Bike %d:\n", bike->Key);
-	printf("  Trip count: %d\n", bike->Value.Bike.TripCount);
+	OutputPrintf(out, "**Bike %d:\n", bike->Key);
+	OutputPrintf(out, "  Trip count: %d\n", BikeValue(bike)->TripCount);
 }
 
 
 //
 // Displays closest stations
 //
-void DisplayClosestStations(ClosestStations *closestStations) {
+void DisplayClosestStations(Output *out, ClosestStations *closestStations) {
 	int i = 0;
 	 
 	// displays stats about closest the stations
 	for (; i < closestStations->count; i++) {
-		printf("Station %d: distance %lf miles\n",
+		OutputPrintf(out, "Station %d: distance %lf miles\n",
 			closestStations->stations[i].stationID,
 			closestStations->stations[i].distance);
 	}
@@ -519,12 +821,12 @@ void DisplayClosestStations(ClosestStations *closestStations) {
 //
 // Displys info about trips
 //
-void DisplayRouteStats(int tripCount, int sourceID, int destID, int totalTrips) {
+void DisplayRouteStats(Output *out, int tripCount, int sourceID, int destID, int totalTrips) {
 
 	// display info
-	printf("** Route: from station #%d to station #%d\n", sourceID, destID);
-	printf("** Trip count: %d\n", tripCount);
-	printf("** Percentage: %lf%%\n", ((double)tripCount / totalTrips) * 100);
+	OutputPrintf(out, "** Route: from station #%d to station #%d\n", sourceID, destID);
+	OutputPrintf(out, "** Trip count: %d\n", tripCount);
+	OutputPrintf(out, "** Percentage: %lf%%\n", totalTrips == 0 ? 0.0 : ((double)tripCount / totalTrips) * 100);
 }
 
 
@@ -539,4 +841,113 @@ Duration ConvertDuration(int seconds) {
 	duration.seconds = seconds % 60;		// get the seconds
 
 	return duration;		// return new duration
-}
\ No newline at end of file
+}
+
+//
+// copies the keys of the tree into keys, in order
+//
+void CollectKeys(AVLNode *node, AVLKey *keys, int *count) {
+
+	AVLIterator iter;
+
+	AVLIteratorInit(&iter, node, AVLInOrder);
+
+	while ((node = AVLInOrderNext(&iter)) != NULL) {
+		keys[*count] = node->Key;
+		*count = *count + 1;
+	}
+}
+
+
+//
+// Displays memory per node and average search time of the tree, and
+// of the same keys in a compact tree with payloads of payloadSize
+// bytes stored in a separate array
+//
+void DisplayLayoutStats(Output *out, char *name, AVL *tree, int payloadSize) {
+
+	int lookups = 1000000;
+	int count = 0;
+	int i;
+	long long found = 0;		// keeps the searches from being optimized away
+	unsigned int random = 12345;
+	double start, avlTime, compactTime;
+
+	if (AVLCount(tree) == 0) {
+		OutputPrintf(out, "   %-9s empty\n", name);
+		return;
+	}
+
+	AVLKey *keys = (AVLKey*)malloc(sizeof(AVLKey) * AVLCount(tree));
+	AVLKey *queries = (AVLKey*)malloc(sizeof(AVLKey) * lookups);
+	CAVL *compact = CAVLCreate();
+
+	CollectKeys(tree->Root, keys, &count);
+	CAVLBuildFromSorted(compact, keys, count);
+
+	// same pseudo-random existing keys for both trees
+	for (i = 0; i < lookups; i++) {
+		random = random * 1103515245u + 12345u;
+		queries[i] = keys[(random >> 8) % count];
+	}
+
+	start = TimerNow();
+	for (i = 0; i < lookups; i++)
+		found += AVLSearch(tree, queries[i])->Key;
+	avlTime = TimerNow() - start;
+
+	start = TimerNow();
+	for (i = 0; i < lookups; i++)
+		found += CAVLSearch(compact, queries[i]);
+	compactTime = TimerNow() - start;
+
+	OutputPrintf(out, "   %-9s %d -> %d + %d bytes, %.1f -> %.1f ns\n", name,
+		tree->NodeSize, (int)sizeof(CAVLNode), payloadSize,
+		avlTime * 1e9 / lookups, compactTime * 1e9 / lookups);
+
+	volatile long long sink = found;
+	(void)sink;
+
+	free(keys);
+	free(queries);
+	CAVLFree(compact);
+}
+
+
+//
+// Displays memory per trip and average lookup time of the trip table
+//
+void DisplayTripTableStats(Output *out, TripTable *trips) {
+
+	int lookups = 1000000;
+	int i;
+	long long found = 0;		// keeps the searches from being optimized away
+	unsigned int random = 12345;
+	double start, tableTime;
+
+	if (TripTableCount(trips) == 0) {
+		OutputPrintf(out, "   %-9s empty\n", "Trips:");
+		return;
+	}
+
+	AVLKey *queries = (AVLKey*)malloc(sizeof(AVLKey) * lookups);
+
+	// pseudo-random existing keys
+	for (i = 0; i < lookups; i++) {
+		random = random * 1103515245u + 12345u;
+		queries[i] = trips->TripID[(random >> 8) % TripTableCount(trips)];
+	}
+
+	start = TimerNow();
+	for (i = 0; i < lookups; i++)
+		found += TripTableFind(trips, queries[i]);
+	tableTime = TimerNow() - start;
+
+	OutputPrintf(out, "   %-9s table, %d + %d bytes, %.1f ns\n", "Trips:",
+		(int)sizeof(CAVLNode), TRIPTABLE_ROW_BYTES, tableTime * 1e9 / lookups);
+
+	volatile long long sink = found;
+	(void)sink;
+
+	free(queries);
+}
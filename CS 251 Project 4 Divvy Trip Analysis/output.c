@@ -0,0 +1,141 @@
+/*output.c*/
+
+//
+// Buffered output sink, implementation file.
+//
+// The Display functions write into an Output instead of calling printf,
+// so the same code prints a result straight to stdout in interactive
+// mode, or into a buffer of its own when batch queries run on several
+// threads and their results are written out afterwards, in order.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "output.h"
+
+
+//
+// OutputInit:
+//
+// Initializes an empty sink writing to file, or to memory only if
+// file is NULL.
+//
+void OutputInit(Output *out, FILE *file) {
+
+	out->File = file;
+	out->Length = 0;
+	out->Size = 4096;
+	out->Data = (char*)malloc(out->Size);
+}
+
+
+//
+// makes room for length more bytes, and the '\0'
+//
+static void _OutputReserve(Output *out, size_t length) {
+
+	if (out->Length + length + 1 <= out->Size)
+		return;
+
+	while (out->Length + length + 1 > out->Size)
+		out->Size *= 2;
+	out->Data = (char*)realloc(out->Data, out->Size);
+}
+
+
+//
+// OutputPrintf:
+//
+// Appends the formatted text, like printf.
+//
+void OutputPrintf(Output *out, const char *format, ...) {
+
+	va_list args;
+	int length;
+
+	// try in the room that is left, most lines fit
+	va_start(args, format);
+	length = vsnprintf(out->Data + out->Length, out->Size - out->Length, format, args);
+	va_end(args);
+
+	if (length < 0)
+		return;
+
+	// didn't fit, grow and format again
+	if ((size_t)length >= out->Size - out->Length) {
+		_OutputReserve(out, (size_t)length);
+		va_start(args, format);
+		vsnprintf(out->Data + out->Length, out->Size - out->Length, format, args);
+		va_end(args);
+	}
+
+	out->Length += (size_t)length;
+
+	if (out->File != NULL && out->Length >= OUTPUT_FLUSH_SIZE)
+		OutputFlush(out);
+}
+
+
+//
+// OutputWrite:
+//
+// Appends length bytes of data as is.
+//
+void OutputWrite(Output *out, const char *data, size_t length) {
+
+	// big and going to a file anyway => no need to copy it
+	if (out->File != NULL && length >= OUTPUT_FLUSH_SIZE) {
+		OutputFlush(out);
+		fwrite(data, 1, length, out->File);
+		return;
+	}
+
+	_OutputReserve(out, length);
+	memcpy(out->Data + out->Length, data, length);
+	out->Length += length;
+	out->Data[out->Length] = '\0';
+
+	if (out->File != NULL && out->Length >= OUTPUT_FLUSH_SIZE)
+		OutputFlush(out);
+}
+
+
+//
+// OutputFlush:
+//
+// Hands the buffered text to the file, if there is one; the file's
+// own buffering decides when it is really written.
+//
+void OutputFlush(Output *out) {
+
+	if (out->File == NULL)
+		return;
+
+	fwrite(out->Data, 1, out->Length, out->File);
+	out->Length = 0;
+}
+
+
+//
+// OutputFree:
+//
+// Flushes and frees the buffer, the file is the caller's.
+//
+void OutputFree(Output *out) {
+
+	OutputFlush(out);
+	free(out->Data);
+	out->Data = NULL;
+	out->Length = 0;
+	out->Size = 0;
+}
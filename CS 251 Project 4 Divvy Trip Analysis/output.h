@@ -0,0 +1,44 @@
+/*output.h*/
+
+//
+// Buffered output sink, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define OUTPUT_FLUSH_SIZE	(64 * 1024)		// written out past this, if there is a file
+
+
+//
+// output type declarations:
+//
+
+// text goes into Data, and from there to File on OutputFlush -- or
+// stays in memory if File is NULL, until the caller writes it out
+typedef struct Output
+{
+	FILE		*File;
+	char		*Data;
+	size_t		Length;
+	size_t		Size;		// room in Data
+
+} Output;
+
+
+//
+// output API:
+// function prototypes
+//
+void OutputInit(Output *out, FILE *file);
+void OutputPrintf(Output *out, const char *format, ...);
+void OutputWrite(Output *out, const char *data, size_t length);
+void OutputFlush(Output *out);
+void OutputFree(Output *out);
@@ -0,0 +1,315 @@
+/*perf.c*/
+
+//
+// Hot-path instrumentation, implementation file.
+//
+// Every thread records into a PerfBlock of its own, taken the first
+// time it records anything.  When a thread ends (see ThreadStart) its
+// block goes back to the pool, with its counts, and the next thread
+// takes it over and adds to them; only when no block is free is one
+// made and pushed onto a global list with a compare-and-swap.  So
+// there are only as many blocks as threads ever running at once, and
+// the counts of threads that are done (batch workers, loader threads)
+// are still there to be summed up.  While other threads are running
+// the sums are only approximate.
+//
+// Latencies go into log-scale histograms: bucket v < 8 holds v ns,
+// above that each power of 2 is split into 4 buckets, so a percentile
+// is off by at most 25%.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#endif
+
+#include "perf.h"
+
+PERF_THREAD_LOCAL PerfBlock *PerfThreadBlock = NULL;
+
+static PerfBlock *volatile _PerfBlocks = NULL;		// list of all blocks
+
+
+//
+// pushes the block onto the global list
+//
+static void _PerfPush(PerfBlock *block) {
+
+#ifdef _MSC_VER
+	PerfBlock *head;
+
+	do {
+		head = _PerfBlocks;
+		block->Next = head;
+	} while (InterlockedCompareExchangePointer((PVOID volatile*)&_PerfBlocks, block, head) != head);
+#else
+	PerfBlock *head = __atomic_load_n(&_PerfBlocks, __ATOMIC_ACQUIRE);
+
+	do {
+		block->Next = head;
+	} while (!__atomic_compare_exchange_n(&_PerfBlocks, &head, block, 1,
+		__ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+#endif
+}
+
+
+//
+// returns the first block of the list
+//
+static PerfBlock *_PerfFirst() {
+
+#ifdef _MSC_VER
+	return (PerfBlock*)InterlockedCompareExchangePointer((PVOID volatile*)&_PerfBlocks, NULL, NULL);
+#else
+	return __atomic_load_n(&_PerfBlocks, __ATOMIC_ACQUIRE);
+#endif
+}
+
+
+//
+// takes the block if no thread has it, returns non-zero if it did
+//
+static int _PerfClaim(PerfBlock *block) {
+
+#ifdef _MSC_VER
+	return InterlockedCompareExchange(&block->InUse, 1, 0) == 0;
+#else
+	long expected = 0;
+
+	return __atomic_compare_exchange_n(&block->InUse, &expected, 1, 0,
+		__ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+#endif
+}
+
+
+//
+// returns this thread's block: a free one of the list, else a new one
+//
+static PerfBlock *_PerfMine() {
+
+	PerfBlock *block;
+
+	if (PerfThreadBlock == NULL) {
+		for (block = _PerfFirst(); block != NULL; block = block->Next) {
+			if (_PerfClaim(block))
+				break;
+		}
+
+		if (block == NULL) {
+			block = (PerfBlock*)calloc(1, sizeof(PerfBlock));
+			block->InUse = 1;
+			_PerfPush(block);
+		}
+
+		PerfThreadBlock = block;
+	}
+
+	return PerfThreadBlock;
+}
+
+
+//
+// bucket of a latency of ns nanoseconds
+//
+static int _PerfBucket(long long ns) {
+
+	int shift = 0;
+
+	if (ns < 0)
+		ns = 0;
+
+	while (ns >= 8) {
+		ns >>= 1;
+		shift++;
+	}
+
+	int bucket = (shift == 0) ? (int)ns : shift * 4 + (int)ns;
+
+	return (bucket < PERF_BUCKETS) ? bucket : PERF_BUCKETS - 1;
+}
+
+
+//
+// PerfRecord:
+//
+// Records a latency of seconds for the probe.
+//
+void PerfRecord(PerfProbe probe, double seconds) {
+
+	PerfHistogram *histogram = &_PerfMine()->Probes[probe];
+	long long ns = (long long)(seconds * 1e9);
+
+	int bucket = _PerfBucket(ns);
+
+	// only this thread writes them
+	PERF_STORE(histogram->Count, PERF_LOAD(histogram->Count) + 1);
+	PERF_STORE(histogram->Total, PERF_LOAD(histogram->Total) + ns);
+	if (ns > PERF_LOAD(histogram->Max))
+		PERF_STORE(histogram->Max, ns);
+	PERF_STORE(histogram->Buckets[bucket], PERF_LOAD(histogram->Buckets[bucket]) + 1);
+}
+
+
+//
+// PerfAdd:
+//
+// Adds n to the counter, see PERF_COUNT for the fast path.
+//
+void PerfAdd(PerfCounter counter, long long n) {
+
+	PerfBlock *block = _PerfMine();
+
+	PERF_STORE(block->Counters[counter], PERF_LOAD(block->Counters[counter]) + n);
+}
+
+
+//
+// PerfThreadEnd:
+//
+// Gives this thread's block back to the pool, called by every thread
+// started with ThreadStart when it ends.  Its counts stay in the sums.
+//
+void PerfThreadEnd() {
+
+	if (PerfThreadBlock == NULL)
+		return;
+
+#ifdef _MSC_VER
+	InterlockedExchange(&PerfThreadBlock->InUse, 0);
+#else
+	__atomic_store_n(&PerfThreadBlock->InUse, 0, __ATOMIC_RELEASE);
+#endif
+	PerfThreadBlock = NULL;
+}
+
+
+//
+// PerfReset:
+//
+// Zeroes the timers and counters of all threads; what other threads
+// record meanwhile may be lost.
+//
+void PerfReset() {
+
+	PerfBlock *block;
+	int p, c, b;
+
+	for (block = _PerfFirst(); block != NULL; block = block->Next) {
+		for (c = 0; c < PERF_COUNTERS; c++)
+			PERF_STORE(block->Counters[c], 0);
+
+		for (p = 0; p < PERF_PROBES; p++) {
+			PERF_STORE(block->Probes[p].Count, 0);
+			PERF_STORE(block->Probes[p].Total, 0);
+			PERF_STORE(block->Probes[p].Max, 0);
+			for (b = 0; b < PERF_BUCKETS; b++)
+				PERF_STORE(block->Probes[p].Buckets[b], 0);
+		}
+	}
+}
+
+
+#ifndef DIVVY_NO_PERF
+static const char *_PerfProbeNames[PERF_PROBES] = {
+	"load stations", "load trips", "load snapshot",
+	"append trips", "station", "trip", "bike", "trips", "rank", "select", "find", "route"
+};
+
+
+//
+// upper end, exclusive, of the latencies in the bucket, in ns
+//
+static long long _PerfBucketEnd(int bucket) {
+
+	if (bucket < 8)
+		return bucket + 1;
+
+	return (long long)(bucket % 4 + 5) << (bucket / 4 - 1);
+}
+
+
+//
+// smallest latency in ns that at least fraction of the histogram is
+// below, up to bucket precision
+//
+static long long _PerfPercentile(PerfHistogram *histogram, double fraction) {
+
+	long long target = (long long)(fraction * histogram->Count + 0.999999);
+	long long seen = 0;
+	int b;
+
+	for (b = 0; b < PERF_BUCKETS; b++) {
+		seen += histogram->Buckets[b];
+		if (seen >= target && seen > 0)
+			break;
+	}
+
+	long long end = _PerfBucketEnd(b < PERF_BUCKETS ? b : PERF_BUCKETS - 1);
+	return (end < histogram->Max) ? end : histogram->Max;
+}
+#endif
+
+
+//
+// PerfDisplay:
+//
+// Displays the latencies of every probe timed so far, and the counts,
+// summed over all threads.
+//
+void PerfDisplay(Output *out) {
+
+#ifdef DIVVY_NO_PERF
+	OutputPrintf(out, "**perf was compiled out, DIVVY_NO_PERF\n");
+#else
+	PerfHistogram total;
+	long long counters[PERF_COUNTERS];
+	PerfBlock *block;
+	int p, c, b;
+
+	memset(counters, 0, sizeof(counters));
+	for (block = _PerfFirst(); block != NULL; block = block->Next) {
+		for (c = 0; c < PERF_COUNTERS; c++)
+			counters[c] += PERF_LOAD(block->Counters[c]);
+	}
+
+	OutputPrintf(out, "** Perf: latency in usecs\n");
+	OutputPrintf(out, "   %-16s %10s %12s %12s %12s %12s\n", "probe", "count", "mean", "p50",
+		"p99", "max");
+
+	for (p = 0; p < PERF_PROBES; p++) {
+		memset(&total, 0, sizeof(total));
+		for (block = _PerfFirst(); block != NULL; block = block->Next) {
+			PerfHistogram *histogram = &block->Probes[p];
+
+			total.Count += PERF_LOAD(histogram->Count);
+			total.Total += PERF_LOAD(histogram->Total);
+			if (PERF_LOAD(histogram->Max) > total.Max)
+				total.Max = PERF_LOAD(histogram->Max);
+			for (b = 0; b < PERF_BUCKETS; b++)
+				total.Buckets[b] += PERF_LOAD(histogram->Buckets[b]);
+		}
+
+		if (total.Count == 0)
+			continue;
+
+		OutputPrintf(out, "   %-16s %10lld %12.3f %12.3f %12.3f %12.3f\n", _PerfProbeNames[p],
+			total.Count, total.Total / 1e3 / total.Count, _PerfPercentile(&total, 0.50) / 1e3,
+			_PerfPercentile(&total, 0.99) / 1e3, total.Max / 1e3);
+	}
+
+	OutputPrintf(out, "** AVL: %lld searches, %.2f nodes/search; %lld inserts, "
+		"%lld single + %lld double rotations\n", counters[PerfSearches],
+		counters[PerfSearches] == 0 ? 0.0 : (double)counters[PerfSearchDepth] / counters[PerfSearches],
+		counters[PerfInserts], counters[PerfSingleRotations], counters[PerfDoubleRotations]);
+#endif
+}
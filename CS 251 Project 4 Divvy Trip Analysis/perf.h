@@ -0,0 +1,120 @@
+/*perf.h*/
+
+//
+// Hot-path instrumentation, header file.
+//
+// Timers and counters are kept per thread, so the hot paths only
+// touch memory of their own thread, and summed up by PerfDisplay.  They
+// are read and written with relaxed atomic loads and stores, as cheap
+// as plain ones, since perf may run while other threads record.
+// Compile with DIVVY_NO_PERF defined to compile all of it out.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "output.h"
+#include "timer.h"
+
+#define PERF_BUCKETS	192		// latency histogram buckets, see perf.c
+
+#ifdef _MSC_VER
+#define PERF_THREAD_LOCAL	__declspec(thread)
+#define PERF_LOAD(x)		(*(volatile long long*)&(x))
+#define PERF_STORE(x, v)	(*(volatile long long*)&(x) = (v))
+#else
+#define PERF_THREAD_LOCAL	__thread
+#define PERF_LOAD(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define PERF_STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#endif
+
+
+//
+// perf type declarations:
+//
+
+// what is timed
+typedef enum PerfProbe
+{
+	PerfLoadStations,		// AVLBuildStationsTree
+	PerfLoadTrips,			// AVLBuildTripsTree
+	PerfLoadSnapshot,		// SnapshotLoad
+	PerfAppendTrips,		// AVLAppendTrips
+	PerfStation,			// queries, see ExecuteQuery
+	PerfTrip,
+	PerfBike,
+	PerfTrips,
+	PerfRank,
+	PerfSelect,
+	PerfFind,
+	PerfRoute,
+	PERF_PROBES
+} PerfProbe;
+
+// what is counted
+typedef enum PerfCounter
+{
+	PerfSearches,			// AVLSearch calls
+	PerfSearchDepth,		// nodes visited by them
+	PerfInserts,			// AVLInsert calls that inserted
+	PerfSingleRotations,	// rebalancing by AVLInsert, case 1 or 4
+	PerfDoubleRotations,	// case 2 or 3
+	PERF_COUNTERS
+} PerfCounter;
+
+// latencies of one probe, in ns
+typedef struct PerfHistogram
+{
+	long long	Count;
+	long long	Total;
+	long long	Max;
+	long long	Buckets[PERF_BUCKETS];
+
+} PerfHistogram;
+
+// the timers and counters of one thread
+typedef struct PerfBlock
+{
+	long long			Counters[PERF_COUNTERS];
+	PerfHistogram		Probes[PERF_PROBES];
+	struct PerfBlock	*Next;		// all blocks, of every thread
+	volatile long		InUse;		// 1 while a thread records into it
+
+} PerfBlock;
+
+// this thread's block, NULL until it records something
+extern PERF_THREAD_LOCAL PerfBlock *PerfThreadBlock;
+
+
+//
+// instrumentation macros, nothing if DIVVY_NO_PERF:
+//   PERF_START(t)          remembers the time in a new variable t
+//   PERF_STOP(probe, t)    records the time since t for the probe
+//   PERF_COUNT(counter, n) adds n to the counter
+//
+#ifndef DIVVY_NO_PERF
+#define PERF_START(t)			double t = TimerNow()
+#define PERF_STOP(probe, t)		PerfRecord(probe, TimerNow() - (t))
+#define PERF_COUNT(counter, n)	((PerfThreadBlock != NULL) ? \
+	(void)PERF_STORE(PerfThreadBlock->Counters[counter], \
+		PERF_LOAD(PerfThreadBlock->Counters[counter]) + (n)) : PerfAdd(counter, n))
+#else
+#define PERF_START(t)
+#define PERF_STOP(probe, t)		((void)0)
+#define PERF_COUNT(counter, n)	((void)sizeof(n))
+#endif
+
+
+//
+// perf API:
+// function prototypes
+//
+void PerfRecord(PerfProbe probe, double seconds);
+void PerfAdd(PerfCounter counter, long long n);
+void PerfThreadEnd();
+void PerfReset();
+void PerfDisplay(Output *out);
@@ -0,0 +1,630 @@
+/*query.c*/
+
+//
+// Query parsing and execution, implementation file.
+//
+// A command is read into a Query first and run afterwards, against
+// the loaded data, writing its results into an Output.  Interactive
+// mode reads one query from stdin, runs it and flushes the output to
+// stdout; batch mode reads a whole query file up front, runs the
+// queries in blocks on several threads -- each block into an output
+// buffer of its own -- and then writes the blocks out in order, so the
+// results are the same as running the file interactively.  Appends
+// change the data, so batch mode runs each of them alone, after the
+// queries before it and before the ones after it.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "query.h"
+#include "ingest.h"
+#include "thread.h"
+#include "timer.h"
+#include "perf.h"
+
+
+//
+// ReadQuery:
+//
+// Reads the next command and its arguments from input; optional
+// arguments are taken from the rest of the line, the others may span
+// lines.  The file name of append / follow is the rest of the line,
+// spaces and all, less the blanks around it.  Returns FALSE at the
+// end of input.
+//
+int ReadQuery(FILE *input, Query *query) {
+
+	char cmd[64];
+	char restOfLine[256];
+	char what[64] = "";
+	char fileName[QUERY_PATH_MAX];
+	char *first, *last;
+	int c;
+
+	memset(query, 0, sizeof(Query));
+	query->Limit = -1;
+
+	if (fscanf(input, "%63s", cmd) != 1) {
+		query->Type = QueryExit;
+		return FALSE;
+	}
+
+	if (strcmp(cmd, "exit") == 0)
+	{
+		query->Type = QueryExit;
+	}
+	else if (strcmp(cmd, "stats") == 0)
+	{
+		query->Type = QueryStats;
+	}
+	else if (strcmp(cmd, "station") == 0)
+	{
+		// "station N from to" => also its trips in the time window
+		query->Type = QueryStation;
+		fscanf(input, "%d", &query->ID);
+		query->Windowed = ReadTimeWindow(input, &query->From, &query->To);
+	}
+	else if (strcmp(cmd, "trip") == 0)
+	{
+		query->Type = QueryTrip;
+		fscanf(input, "%d", &query->ID);
+	}
+	else if (strcmp(cmd, "bike") == 0)
+	{
+		// "bike N trips" => also its trips
+		fscanf(input, "%d", &query->ID);
+		if (fgets(restOfLine, sizeof(restOfLine), input) != NULL)
+			sscanf(restOfLine, "%63s", what);
+
+		query->Type = (strcmp(what, "trips") == 0) ? QueryBikeTrips : QueryBike;
+	}
+	else if (strcmp(cmd, "trips") == 0)
+	{
+		query->Type = QueryTrips;
+		fscanf(input, "%d %d", &query->ID, &query->Hi);
+	}
+	else if (strcmp(cmd, "rank") == 0 || strcmp(cmd, "select") == 0)
+	{
+		query->Type = (strcmp(cmd, "rank") == 0) ? QueryRank : QuerySelect;
+		fscanf(input, "%63s %d", query->Name, &query->ID);
+	}
+	else if (strcmp(cmd, "find") == 0)
+	{
+		query->Type = QueryFind;
+		fscanf(input, "%lf %lf %lf", &query->Location.latitude, &query->Location.longtitude,
+			&query->Distance);
+		// optional limit on the rest of the line, -1 => all of them
+		if (fgets(restOfLine, sizeof(restOfLine), input) != NULL)
+			if (sscanf(restOfLine, "%d", &query->Limit) != 1 || query->Limit < 0)
+				query->Limit = -1;
+	}
+	else if (strcmp(cmd, "route") == 0)
+	{
+		// "route N dist from to" => only trips in the time window
+		query->Type = QueryRoute;
+		fscanf(input, "%d %lf", &query->ID, &query->Distance);
+		query->Windowed = ReadTimeWindow(input, &query->From, &query->To);
+	}
+	else if (strcmp(cmd, "layout") == 0)
+	{
+		query->Type = QueryLayout;
+	}
+	else if (strcmp(cmd, "perf") == 0)
+	{
+		// "perf reset" => start over
+		if (fgets(restOfLine, sizeof(restOfLine), input) != NULL)
+			sscanf(restOfLine, "%63s", what);
+
+		query->Type = (strcmp(what, "reset") == 0) ? QueryPerfReset : QueryPerf;
+	}
+	else if (strcmp(cmd, "append") == 0 || strcmp(cmd, "follow") == 0)
+	{
+		query->Type = (strcmp(cmd, "append") == 0) ? QueryAppend : QueryFollow;
+		if (fgets(fileName, sizeof(fileName), input) == NULL)
+			fileName[0] = '\0';
+		else if (strchr(fileName, '\n') == NULL) {
+			// too long: drop the rest of the line, the name won't open
+			while ((c = fgetc(input)) != EOF && c != '\n')
+				;
+		}
+
+		// trim the blanks, and the '\n', around the name
+		first = fileName;
+		while (*first == ' ' || *first == '\t')
+			first++;
+		last = first + strlen(first);
+		while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\n'
+			|| last[-1] == '\r'))
+			last--;
+		*last = '\0';
+
+		query->FileName = (char*)malloc(strlen(first) + 1);
+		strcpy(query->FileName, first);
+	}
+	else
+	{
+		query->Type = QueryUnknown;
+	}
+
+	return TRUE;
+}
+
+
+//
+// QueryFree:
+//
+// Frees what ReadQuery allocated for the query, not the query itself.
+//
+void QueryFree(Query *query) {
+
+	free(query->FileName);
+	query->FileName = NULL;
+}
+
+
+//
+// runs the route query: trips between the stations near both ends of
+// the given trip
+//
+static void _ExecuteRoute(DivvyData *data, Query *query, Output *out) {
+
+	TripTable *trips = data->Trips;
+	int tripCount = 0;						// number of trips
+	AVLNode *sourceNode;					// source station
+	AVLNode *destNode;						// destination station
+	Coords sourceCoords, destCoords;		// coordinates of the stations
+	IDList *sources;						// set of source stations
+	IDList *destinations;					// set of destination stations
+
+	// grab the info about given trip
+	int row = TripTableFind(trips, query->ID);
+
+	if (row < 0) {		// not found
+		OutputPrintf(out, "**not found\n");
+		return;
+	}
+
+	// store info from trip into source and destination ID's
+	int sourceID = trips->FromID[row];
+	int destID = trips->ToID[row];
+
+	// find the nodes
+	sourceNode = IDTableSearch(data->StationTable, &data->Stations->Base, sourceID);
+	destNode = IDTableSearch(data->StationTable, &data->Stations->Base, destID);
+
+	// assign coords
+	sourceCoords = StationValue(sourceNode)->Coordinates;
+	destCoords = StationValue(destNode)->Coordinates;
+
+	// build sources and destination subsets
+	sources = InitializeIDList();
+	destinations = InitializeIDList();
+	KDBuildSubSet(data->StationIndex, sources, sourceCoords, query->Distance);
+	KDBuildSubSet(data->StationIndex, destinations, destCoords, query->Distance);
+
+	// count trips
+	if (query->Windowed) {
+		int windowTrips = 0;
+		tripCount = CountRouteTrips(trips, &data->TripsByTime, query->From, query->To,
+			sources, destinations, &windowTrips);
+		DisplayRouteStats(out, tripCount, sourceID, destID, windowTrips);
+	}
+	else {
+		tripCount = RouteMatrixCountTrips(data->Routes, sources, destinations);
+		DisplayRouteStats(out, tripCount, sourceID, destID, TripTableCount(trips));
+	}
+
+	// free the memory
+	FreeIDList(sources);
+	FreeIDList(destinations);
+}
+
+
+//
+// runs the find query: stations within the distance, closest first
+//
+static void _ExecuteFind(DivvyData *data, Query *query, Output *out) {
+
+	// array to hold set of locations
+	ClosestStations *closestStations = (ClosestStations*)malloc(sizeof(ClosestStations));
+
+	InitializeClosestStations(closestStations);
+
+	// search the spatial index and insert stations into array
+	closestStations = KDFindClosestStations(data->StationIndex, query->Location,
+		query->Distance, closestStations);
+	// keep the closest ones, sorted by distance, secondary by id
+	KeepClosestStations(closestStations, query->Limit);
+	// display closest stations
+	DisplayClosestStations(out, closestStations);
+
+	// free the memory
+	free(closestStations->stations);
+	free(closestStations);
+}
+
+
+//
+// displays the count and height of the version of a tree at root
+//
+static void _DisplayTreeStats(Output *out, char *name, AVLNode *root) {
+
+	OutputPrintf(out, "   %-9s count = %d, height = %d\n", name,
+		(root == NULL) ? 0 : root->Size, (root == NULL) ? -1 : root->Height);
+}
+
+
+//
+// displays how many versions of the tree are held, and the nodes kept
+// for them that the current version no longer uses
+//
+static void _DisplayVersions(Output *out, char *name, AVL *tree) {
+
+	int versions, held;
+
+	AVLVersionUsage(tree, &versions, &held);
+
+	OutputPrintf(out, "   %-9s %d held, %d nodes kept, %.1f KB/version\n", name, versions, held,
+		(versions == 0) ? 0.0 : (double)held * tree->NodeSize / 1024 / versions);
+}
+
+
+//
+// perf probe of the query type, -1 => not timed
+//
+static int _QueryProbe(QueryType type) {
+
+	switch (type)
+	{
+	case QueryStation:		return PerfStation;
+	case QueryTrip:			return PerfTrip;
+	case QueryBike:
+	case QueryBikeTrips:	return PerfBike;
+	case QueryTrips:		return PerfTrips;
+	case QueryRank:			return PerfRank;
+	case QuerySelect:		return PerfSelect;
+	case QueryFind:			return PerfFind;
+	case QueryRoute:		return PerfRoute;
+	default:				return -1;
+	}
+}
+
+
+//
+// ExecuteQuery:
+//
+// Runs the query, writing its results to out, and times it.  Only
+// append and follow change the data, all other queries can run on
+// several threads at once.
+//
+void ExecuteQuery(DivvyData *data, Query *query, Output *out) {
+
+	TripTable *trips = data->Trips;
+	AVLNode *station;
+	AVLVersion *stations, *bikes;
+	AVL *tree;
+	int count = 0;
+	int i;
+	PERF_START(start);
+
+	switch (query->Type)
+	{
+	case QueryStats:
+		//
+		// Output some stats about our data structures, each tree from
+		// one version of it:
+		//
+		stations = AVLVersionTake(&data->Stations->Base);
+		bikes = AVLVersionTake(&data->Bikes->Base);
+
+		OutputPrintf(out, "** Trees:\n");
+
+		_DisplayTreeStats(out, "Stations:", stations->Root);
+		OutputPrintf(out, "   Trips:    count = %d, height = %d\n",
+			TripTableCount(trips), TripTableHeight(trips));
+		_DisplayTreeStats(out, "Bikes:", bikes->Root);
+		OutputPrintf(out, "** Trip table: %.1f bytes/trip\n", TripTableCount(trips) == 0 ? 0.0 :
+			(double)TripTableBytes(trips) / TripTableCount(trips));
+
+		AVLVersionRelease(stations);
+		AVLVersionRelease(bikes);
+		break;
+
+	case QueryStation:
+		// display info about station, and its trips in the time window
+		station = IDTableSearch(data->StationTable, &data->Stations->Base, query->ID);
+		DisplayStationInfo(out, station);
+		if (query->Windowed && station != NULL)
+			OutputPrintf(out, "  Trips in window: %d\n", CountStationTrips(trips,
+				&data->TripsByTime, query->From, query->To, query->ID));
+		break;
+
+	case QueryTrip:
+		DisplayTripInfo(out, trips, TripTableFind(trips, query->ID));
+		break;
+
+	case QueryBike:
+		DisplayBikeInfo(out, IDTableSearch(data->BikeTable, &data->Bikes->Base, query->ID));
+		break;
+
+	case QueryBikeTrips:
+		DisplayBikeTrips(out, IDTableSearch(data->BikeTable, &data->Bikes->Base, query->ID),
+			&data->BikeTrips, trips);
+		break;
+
+	case QueryTrips:
+		// display the trips with ids in [lo, hi], one line each
+		for (i = TripTableLowerBound(trips, query->ID);
+			i < trips->Count && trips->TripID[i] <= query->Hi; i++) {
+			DisplayTripLine(out, trips, i);
+			count++;
+		}
+		OutputPrintf(out, "** Trips in [%d, %d]: %d\n", query->ID, query->Hi, count);
+		break;
+
+	case QueryRank:
+		// # of ids below the given one in stations, trips or bikes
+		tree = SelectTree(query->Name, data->Stations, data->Bikes);
+
+		if (strcmp(query->Name, "trips") == 0)
+			DisplayRank(out, query->Name, query->ID, TripTableLowerBound(trips, query->ID),
+				TripTableCount(trips));
+		else if (tree == NULL)
+			OutputPrintf(out, "**unknown tree, try stations, trips or bikes\n");
+		else
+			DisplayRank(out, query->Name, query->ID, AVLRank(tree, query->ID), AVLCount(tree));
+		break;
+
+	case QuerySelect:
+		// k-th smallest id in stations, trips or bikes, k = 1 => smallest
+		tree = SelectTree(query->Name, data->Stations, data->Bikes);
+
+		if (strcmp(query->Name, "trips") == 0)
+			DisplayTripInfo(out, trips,
+				(query->ID >= 1 && query->ID <= TripTableCount(trips)) ? query->ID - 1 : -1);
+		else if (tree == NULL)
+			OutputPrintf(out, "**unknown tree, try stations, trips or bikes\n");
+		else if (tree == &data->Stations->Base)
+			DisplayStationInfo(out, AVLSelect(tree, query->ID - 1));
+		else
+			DisplayBikeInfo(out, AVLSelect(tree, query->ID - 1));
+		break;
+
+	case QueryFind:
+		_ExecuteFind(data, query, out);
+		break;
+
+	case QueryRoute:
+		_ExecuteRoute(data, query, out);
+		break;
+
+	case QueryLayout:
+		// compare AVLNode trees with compact trees + typed payloads
+		OutputPrintf(out, "** Layout: bytes/node, search time (AVLNode -> compact):\n");
+		DisplayLayoutStats(out, "Stations:", &data->Stations->Base, sizeof(STATION));
+		DisplayTripTableStats(out, trips);
+		DisplayLayoutStats(out, "Bikes:", &data->Bikes->Base, sizeof(BIKE));
+		break;
+
+	case QueryPerf:
+		PerfDisplay(out);
+		OutputPrintf(out, "** Versions: held by readers, memory kept for them\n");
+		_DisplayVersions(out, "Stations:", &data->Stations->Base);
+		_DisplayVersions(out, "Bikes:", &data->Bikes->Base);
+		break;
+
+	case QueryPerfReset:
+		PerfReset();
+		OutputPrintf(out, "** Perf: reset\n");
+		break;
+
+	case QueryAppend:
+	case QueryFollow:
+		// new rows of a trips file
+		if (data->Files == NULL)
+			OutputPrintf(out, "**append is not available\n");
+		else
+			IngestAppend(data, query->FileName, query->Type == QueryFollow, out);
+		break;
+
+	case QueryExit:
+		break;
+
+	default:
+		OutputPrintf(out, "**unknown cmd, try again...\n");
+		break;
+	}
+
+	if (_QueryProbe(query->Type) >= 0)
+		PERF_STOP((PerfProbe)_QueryProbe(query->Type), start);
+}
+
+
+//
+// a batch worker runs blocks First, First + Step, ... of the queries,
+// block b into Results[b]
+//
+typedef struct BatchWork
+{
+	DivvyData	*Data;
+	Query		*Queries;
+	int			Count;
+	Output		*Results;
+	int			First;
+	int			Step;
+
+} BatchWork;
+
+static void _BatchWorker(void *arg) {
+
+	BatchWork *work = (BatchWork*)arg;
+	int blocks = (work->Count + QUERY_BATCH_BLOCK - 1) / QUERY_BATCH_BLOCK;
+	int b, i;
+
+	for (b = work->First; b < blocks; b += work->Step) {
+		int end = (b + 1) * QUERY_BATCH_BLOCK;
+		if (end > work->Count)
+			end = work->Count;
+
+		for (i = b * QUERY_BATCH_BLOCK; i < end; i++)
+			ExecuteQuery(work->Data, &work->Queries[i], &work->Results[b]);
+	}
+}
+
+
+//
+// TRUE for the queries that change the data
+//
+static int _QueryWrites(Query *query) {
+
+	return query->Type == QueryAppend || query->Type == QueryFollow;
+}
+
+
+//
+// runs count queries on the given # of threads, block b of them into
+// results[b], and returns how long that took
+//
+static double _BatchRun(DivvyData *data, Query *queries, int count, Output *results,
+	int threads) {
+
+	int t;
+
+	BatchWork *work = (BatchWork*)malloc(sizeof(BatchWork) * threads);
+	Thread *workers = (Thread*)malloc(sizeof(Thread) * threads);
+	int *started = (int*)malloc(sizeof(int) * threads);
+
+	double start = TimerNow();
+
+	for (t = 0; t < threads; t++) {
+		work[t].Data = data;
+		work[t].Queries = queries;
+		work[t].Count = count;
+		work[t].Results = results;
+		work[t].First = t;
+		work[t].Step = threads;
+	}
+
+	// run the blocks, the last worker on this thread:
+	for (t = 0; t < threads - 1; t++) {
+		started[t] = ThreadStart(&workers[t], _BatchWorker, &work[t]);
+		if (!started[t])
+			_BatchWorker(&work[t]);		// no thread, do it here
+	}
+	_BatchWorker(&work[threads - 1]);
+
+	for (t = 0; t < threads - 1; t++) {
+		if (started[t])
+			ThreadJoin(&workers[t]);
+	}
+
+	free(work);
+	free(workers);
+	free(started);
+
+	return TimerNow() - start;
+}
+
+
+//
+// RunBatch:
+//
+// Reads all queries of the file, up to "exit" or its end, runs them
+// on the given # of threads and writes the results to output, in the
+// order of the queries.  An append or follow runs alone, the queries
+// between them on the threads.  Reports queries/s on stderr.  Returns
+// FALSE if the file can't be opened.
+//
+int RunBatch(DivvyData *data, char *queryFileName, int threads, FILE *output) {
+
+	FILE *input = fopen(queryFileName, "r");
+	int size = 1024;
+	int count = 0;
+	int first, blocks;
+	int b, i;
+
+	if (input == NULL)
+		return FALSE;
+
+	// parse everything up front
+	double start = TimerNow();
+	Query *queries = (Query*)malloc(sizeof(Query) * size);
+
+	while (ReadQuery(input, &queries[count]) && queries[count].Type != QueryExit) {
+		count++;
+		if (count == size) {
+			size *= 2;
+			queries = (Query*)realloc(queries, sizeof(Query) * size);
+		}
+	}
+	fclose(input);
+
+	double parseSeconds = TimerNow() - start;
+
+	// one output buffer per block of queries, interleaved over the
+	// threads so slow queries spread out, and one per append
+	blocks = 0;
+	for (i = 0, first = 0; i <= count; i++) {
+		if (i == count || _QueryWrites(&queries[i])) {
+			blocks += (i - first + QUERY_BATCH_BLOCK - 1) / QUERY_BATCH_BLOCK;
+			blocks += (i < count);
+			first = i + 1;
+		}
+	}
+
+	Output *results = (Output*)malloc(sizeof(Output) * (blocks + 1));
+	for (b = 0; b < blocks; b++)
+		OutputInit(&results[b], NULL);
+
+	if (threads > blocks)
+		threads = blocks;
+	if (threads < 1)
+		threads = 1;
+
+	start = TimerNow();
+	double runSeconds = 0;
+
+	for (i = 0, first = 0, b = 0; i <= count; i++) {
+		if (i == count || _QueryWrites(&queries[i])) {
+			runSeconds += _BatchRun(data, &queries[first], i - first, &results[b], threads);
+			b += (i - first + QUERY_BATCH_BLOCK - 1) / QUERY_BATCH_BLOCK;
+
+			if (i < count) {
+				double appendStart = TimerNow();
+				ExecuteQuery(data, &queries[i], &results[b++]);
+				runSeconds += TimerNow() - appendStart;
+			}
+			first = i + 1;
+		}
+	}
+
+	// write the results in order, through one buffered writer
+	Output writer;
+	OutputInit(&writer, output);
+	for (b = 0; b < blocks; b++) {
+		OutputWrite(&writer, results[b].Data, results[b].Length);
+		OutputFree(&results[b]);
+	}
+	OutputFree(&writer);
+
+	double seconds = parseSeconds + (TimerNow() - start);
+	fprintf(stderr, "** Batch: %d queries in %.3f secs (%.0f queries/s; parse %.3f, run %.3f "
+		"on %d threads)\n", count, seconds, count / (seconds > 0 ? seconds : 1e-9),
+		parseSeconds, runSeconds, threads);
+
+	for (i = 0; i < count; i++)
+		QueryFree(&queries[i]);
+	free(queries);
+	free(results);
+
+	return TRUE;
+}
@@ -0,0 +1,124 @@
+/*query.h*/
+
+//
+// Query parsing and execution, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include <stdio.h>
+#include <limits.h>
+
+#include "avl.h"
+#include "kdtree.h"
+#include "idtable.h"
+#include "routes.h"
+#include "triptable.h"
+#include "output.h"
+
+#define QUERY_BATCH_BLOCK	256		// queries per block of work in batch mode
+
+// longest file name of append / follow, with its '\0'
+#ifdef _WIN32
+#define QUERY_PATH_MAX		260			// MAX_PATH
+#elif defined(PATH_MAX)
+#define QUERY_PATH_MAX		PATH_MAX
+#else
+#define QUERY_PATH_MAX		4096		// PATH_MAX of Linux, not declared under -std=c11
+#endif
+
+
+//
+// query type declarations:
+//
+
+// the commands
+typedef enum QueryType
+{
+	QueryStats,
+	QueryStation,			// station N [from to]
+	QueryTrip,				// trip N
+	QueryBike,				// bike N
+	QueryBikeTrips,			// bike N trips
+	QueryTrips,				// trips lo hi
+	QueryRank,				// rank tree N
+	QuerySelect,			// select tree k
+	QueryFind,				// find lat long dist [k]
+	QueryRoute,				// route N dist [from to]
+	QueryLayout,
+	QueryPerf,				// perf
+	QueryPerfReset,			// perf reset
+	QueryAppend,			// append file
+	QueryFollow,			// follow file
+	QueryUnknown,
+	QueryExit				// "exit" or end of input
+} QueryType;
+
+// one parsed command and its arguments
+typedef struct Query
+{
+	QueryType	Type;
+	int			ID;			// station, trip or bike id, lo of trips, k of select
+	int			Hi;			// hi of trips
+	char		Name[64];	// tree of rank / select
+	char		*FileName;	// file of append / follow, see QueryFree
+	Coords		Location;	// of find
+	double		Distance;	// of find and route
+	int			Limit;		// of find, -1 => all stations
+	int			Windowed;	// TRUE if [From, To) was given
+	long long	From;
+	long long	To;
+
+} Query;
+
+// trips files appended from, see ingest.h
+typedef struct IngestFiles IngestFiles;
+
+// everything the queries run against, changed only by append and follow
+typedef struct DivvyData
+{
+	StationTree	*Stations;
+	TripTable	*Trips;
+	BikeTree	*Bikes;
+	RouteMatrix	*Routes;
+	TripList	BikeTrips;			// trips of each bike
+	TripList	TripsByTime;		// trips by start time
+	KDTree		*StationIndex;		// spatial index over the stations
+	IDTable		*StationTable;		// direct-mapped lookup, NULL if sparse
+	IDTable		*BikeTable;
+	IngestFiles	*Files;				// NULL => no appends
+
+} DivvyData;
+
+
+//
+// query API:
+// function prototypes
+//
+int ReadQuery(FILE *input, Query *query);
+void QueryFree(Query *query);
+void ExecuteQuery(DivvyData *data, Query *query, Output *out);
+int RunBatch(DivvyData *data, char *queryFileName, int threads, FILE *output);
+
+
+
+//
+// main.c
+// function prototypes that read a FILE or write into an Output
+//
+void DisplayStationInfo(Output *out, AVLNode *station);
+void DisplayTripInfo(Output *out, TripTable *trips, int row);
+void DisplayTripLine(Output *out, TripTable *trips, int row);
+void DisplayBikeTrips(Output *out, AVLNode *bike, TripList *bikeTrips, TripTable *trips);
+int ReadTimeWindow(FILE *input, long long *from, long long *to);
+void DisplayTripTableStats(Output *out, TripTable *trips);
+void DisplayBikeInfo(Output *out, AVLNode *bike);
+void DisplayClosestStations(Output *out, ClosestStations *closestStations);
+void DisplayRouteStats(Output *out, int tripCount, int sourceID, int destID, int totalTrips);
+void DisplayRank(Output *out, char *name, int id, int rank, int count);
+void DisplayLayoutStats(Output *out, char *name, AVL *tree, int payloadSize);
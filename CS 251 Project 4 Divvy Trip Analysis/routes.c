@@ -0,0 +1,179 @@
+/*routes.c*/
+
+//
+// Origin / destination trip matrix, implementation file.
+//
+// Filled in while the trips tree is built, so "route" sums
+// |sources| x |destinations| cells instead of walking every trip.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "routes.h"
+
+
+//
+// hashes the (fromID, toID) pair into [0, size)
+//
+static unsigned int _RouteHash(int fromID, int toID, int size) {
+
+	unsigned int h = (unsigned int)fromID * 0x9E3779B1u;
+	h ^= (unsigned int)toID + 0x7F4A7C15u + (h << 6) + (h >> 2);
+	h ^= h >> 15;
+	h *= 0x2C1B3C6Du;
+	h ^= h >> 12;
+
+	return h & (unsigned int)(size - 1);
+}
+
+
+//
+// returns the cell holding the pair, or the empty cell where it goes
+//
+static RouteCount *_RouteFind(RouteMatrix *routes, int fromID, int toID) {
+
+	unsigned int i = _RouteHash(fromID, toID, routes->size);
+
+	// linear probing
+	while (routes->cells[i].Count != 0) {
+		if (routes->cells[i].FromID == fromID && routes->cells[i].ToID == toID)
+			return &routes->cells[i];
+		i = (i + 1) & (unsigned int)(routes->size - 1);
+	}
+
+	return &routes->cells[i];
+}
+
+
+//
+// doubles the size of the table, rehashing the cells
+//
+static void _RouteGrow(RouteMatrix *routes) {
+
+	int i;
+	RouteCount *old = routes->cells;
+	int oldSize = routes->size;
+
+	routes->size *= 2;
+	routes->cells = (RouteCount*)calloc(routes->size, sizeof(RouteCount));
+
+	// copy the cells over
+	for (i = 0; i < oldSize; i++) {
+		if (old[i].Count != 0)
+			*_RouteFind(routes, old[i].FromID, old[i].ToID) = old[i];
+	}
+
+	free(old);
+}
+
+
+//
+// RouteMatrixCreate:
+//
+// Creates an empty matrix.
+//
+RouteMatrix *RouteMatrixCreate() {
+
+	RouteMatrix *routes = (RouteMatrix*)malloc(sizeof(RouteMatrix));
+
+	// 1024 cells initially
+	routes->size = 1024;
+	routes->count = 0;
+	routes->cells = (RouteCount*)calloc(routes->size, sizeof(RouteCount));
+
+	return routes;
+}
+
+
+//
+// RouteMatrixAdd:
+//
+// Adds count trips from fromID to toID.
+//
+void RouteMatrixAdd(RouteMatrix *routes, int fromID, int toID, int count) {
+
+	if (count <= 0)
+		return;
+
+	RouteCount *cell = _RouteFind(routes, fromID, toID);
+
+	if (cell->Count != 0) {		// already there, update count
+		cell->Count += count;
+		return;
+	}
+
+	cell->FromID = fromID;
+	cell->ToID = toID;
+	cell->Count = count;
+	routes->count++;
+
+	// keep the table at most half full
+	if (routes->count * 2 > routes->size)
+		_RouteGrow(routes);
+}
+
+
+//
+// RouteMatrixGet:
+//
+// Returns # of trips from fromID to toID.
+//
+int RouteMatrixGet(RouteMatrix *routes, int fromID, int toID) {
+
+	return _RouteFind(routes, fromID, toID)->Count;
+}
+
+
+//
+// RouteMatrixCountTrips:
+//
+// Returns # of trips from any station in sources to any station in
+// destinations, same as AVLCountTrips over the whole trips tree.  If
+// there are more (source, destination) pairs than non-empty cells, the
+// cells are scanned instead, checking both ends against the sets.
+//
+int RouteMatrixCountTrips(RouteMatrix *routes, IDList *sources, IDList *destinations) {
+
+	int i, j;
+	int count = 0;
+
+	if ((double)sources->count * destinations->count > routes->count) {
+		for (i = 0; i < routes->size; i++) {
+			if (routes->cells[i].Count != 0
+				&& SearchArray(sources, routes->cells[i].FromID)
+				&& SearchArray(destinations, routes->cells[i].ToID))
+				count += routes->cells[i].Count;
+		}
+
+		return count;
+	}
+
+	for (i = 0; i < sources->count; i++) {
+		for (j = 0; j < destinations->count; j++) {
+			count += RouteMatrixGet(routes, sources->arr[i], destinations->arr[j]);
+		}
+	}
+
+	return count;
+}
+
+
+//
+// RouteMatrixFree:
+//
+// Frees the matrix.
+//
+void RouteMatrixFree(RouteMatrix *routes) {
+
+	free(routes->cells);
+	free(routes);
+}
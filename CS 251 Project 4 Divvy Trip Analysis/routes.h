@@ -0,0 +1,48 @@
+/*routes.h*/
+
+//
+// Origin / destination trip matrix, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "avl.h"
+
+
+//
+// route matrix type declarations:
+//
+
+// number of trips from one station to another
+typedef struct RouteCount
+{
+	int		FromID;
+	int		ToID;
+	int		Count;		// 0 => empty cell
+
+} RouteCount;
+
+// sparse from-station / to-station matrix, stored as an open
+// addressing hash table of (FromID, ToID) pairs
+struct RouteMatrix
+{
+	RouteCount	*cells;
+	int			count;		// # of non-empty cells
+	int			size;		// always a power of 2
+};
+
+
+//
+// route matrix API:
+// function prototypes
+//
+RouteMatrix *RouteMatrixCreate();
+void RouteMatrixAdd(RouteMatrix *routes, int fromID, int toID, int count);
+int RouteMatrixGet(RouteMatrix *routes, int fromID, int toID);
+int RouteMatrixCountTrips(RouteMatrix *routes, IDList *sources, IDList *destinations);
+void RouteMatrixFree(RouteMatrix *routes);
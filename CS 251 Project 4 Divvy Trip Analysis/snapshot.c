@@ -0,0 +1,435 @@
+/*snapshot.c*/
+
+//
+// Binary snapshot of the loaded trees, implementation file.
+//
+// After the CSV files are loaded, the trees, trip table, route matrix
+// and trip indexes are written to x.csv.snap in a flat binary layout; the next
+// start maps that file, bulk builds the trees and copies the trip
+// columns straight from it, with no text parsing or counting at all.  The snapshot is only used
+// if its version and structure sizes match this build, the size and
+// modification time of both CSV files are still the ones it was made
+// from, and the checksum of its contents is right -- otherwise the
+// CSV files are loaded as usual and a new snapshot is written.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+#include "csv.h"
+#include "timer.h"
+#include "perf.h"
+
+
+//
+// gets the size and modification time of the file, returns FALSE if
+// it can't
+//
+static int _SnapshotStamp(const char *filename, FileStamp *stamp) {
+
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(filename, &info) != 0)
+		return FALSE;
+#else
+	struct stat info;
+	if (stat(filename, &info) != 0)
+		return FALSE;
+#endif
+
+	stamp->Size = (long long)info.st_size;
+	stamp->ModifiedTime = (long long)info.st_mtime;
+	return TRUE;
+}
+
+
+//
+// size of a section of count items, padded to 8 bytes
+//
+static size_t _SnapshotPadded(size_t itemSize, int count) {
+
+	return (itemSize * (size_t)count + 7) & ~(size_t)7;
+}
+
+
+//
+// adds data[0, size) to the checksum, 8 bytes at a time; the last
+// partial word is padded with zeros, like the sections in the file
+//
+static unsigned long long _SnapshotChecksum(unsigned long long h, const void *data, size_t size) {
+
+	const unsigned char *p = (const unsigned char*)data;
+	unsigned long long word;
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy(&word, p + i, 8);
+		h = (h ^ word) * 0x100000001B3ULL;
+		h ^= h >> 32;
+	}
+
+	if (i < size) {
+		word = 0;
+		memcpy(&word, p + i, size - i);
+		h = (h ^ word) * 0x100000001B3ULL;
+		h ^= h >> 32;
+	}
+
+	return h;
+}
+
+#define SNAPSHOT_SEED 0xCBF29CE484222325ULL
+
+
+//
+// writes a section, padded to 8 bytes, and adds it to the checksum
+//
+static void _SnapshotWrite(FILE *out, const void *data, size_t itemSize, int count,
+	unsigned long long *checksum) {
+
+	static const char zeros[8] = { 0 };
+	size_t size = itemSize * (size_t)count;
+	size_t padded = _SnapshotPadded(itemSize, count);
+
+	fwrite(data, 1, size, out);
+	fwrite(zeros, 1, padded - size, out);
+
+	*checksum = _SnapshotChecksum(*checksum, data, size);
+}
+
+
+//
+// copies the keys of the tree into keys, and its values into values,
+// in order
+//
+static void _SnapshotCollect(AVL *tree, AVLKey *keys, char *values) {
+
+	AVLIterator iter;
+	AVLNode *node;
+	int count = 0;
+
+	AVLIteratorInit(&iter, tree->Root, AVLInOrder);
+	while ((node = AVLInOrderNext(&iter)) != NULL) {
+		keys[count] = node->Key;
+		memcpy(values + (size_t)tree->ValueSize * count, AVL_NODE_VALUE(node), tree->ValueSize);
+		count++;
+	}
+}
+
+
+//
+// returns the (key, value) pairs of count keys and their values, as
+// written by _SnapshotCollect, to build a tree from; free them after
+//
+static AVLPair *_SnapshotPairs(const AVLKey *keys, const char *values, int valueSize, int count) {
+
+	AVLPair *pairs = (AVLPair*)malloc(sizeof(AVLPair) * (count + 1));
+	int i;
+
+	for (i = 0; i < count; i++) {
+		pairs[i].Key = keys[i];
+		pairs[i].Value = values + (size_t)valueSize * i;
+	}
+
+	return pairs;
+}
+
+
+//
+// SnapshotSave:
+//
+// Writes the snapshot of the loaded data to snapshotFileName, through
+// a temporary file so a half-written snapshot is never used.  Returns
+// TRUE if successful.
+//
+int SnapshotSave(char *snapshotFileName, char *StationsFileName, char *TripsFileName,
+	StationTree *stations, TripTable *trips, BikeTree *bikes, RouteMatrix *routes,
+	TripList *bikeTrips, TripList *tripsByTime, char *stationNames, double csvLoadSeconds) {
+
+	SnapshotHeader header;
+	AVLIterator iter;
+	AVLNode *node;
+	int i;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, SNAPSHOT_MAGIC, 8);
+	header.Version = SNAPSHOT_VERSION;
+	header.StationSize = sizeof(STATION);
+	header.BikeSize = sizeof(BIKE);
+	header.RouteCellSize = sizeof(RouteCount);
+	header.StationCount = AVLCount(&stations->Base);
+	header.TripCount = TripTableCount(trips);
+	header.BikeCount = AVLCount(&bikes->Base);
+	header.RouteSize = routes->size;
+	header.RouteCount = routes->count;
+	header.CSVLoadSeconds = csvLoadSeconds;
+
+	if (!_SnapshotStamp(StationsFileName, &header.Stations)
+		|| !_SnapshotStamp(TripsFileName, &header.Trips))
+		return FALSE;
+
+	// one row per trip in each list, not the bike lists after appends
+	if (bikeTrips->Count != header.TripCount || tripsByTime->Count != header.TripCount)
+		return FALSE;
+
+	char *tempName = (char*)malloc(strlen(snapshotFileName) + 5);
+	strcpy(tempName, snapshotFileName);
+	strcat(tempName, ".tmp");
+
+	FILE *out = fopen(tempName, "wb");
+	if (out == NULL) {
+		free(tempName);
+		return FALSE;
+	}
+
+	// header goes in last, once the checksum is known
+	fwrite(&header, sizeof(header), 1, out);
+
+	// room for the biggest tree, zeroed so the padding inside the
+	// values is always the same
+	int most = header.StationCount;
+	if (header.BikeCount > most)
+		most = header.BikeCount;
+
+	AVLKey *keys = (AVLKey*)malloc(sizeof(AVLKey) * (most + 1));
+	size_t valuesSize = (sizeof(STATION) > sizeof(BIKE) ? sizeof(STATION) : sizeof(BIKE)) * (most + 1);
+	char *values = (char*)calloc(1, valuesSize);
+	int *indexes = (int*)malloc(sizeof(int) * (most + 1));
+	unsigned long long checksum = SNAPSHOT_SEED;
+
+	// stations, where their names are, and the names
+	_SnapshotCollect(&stations->Base, keys, values);
+	i = 0;
+	AVLIteratorInit(&iter, stations->Base.Root, AVLInOrder);
+	while ((node = AVLInOrderNext(&iter)) != NULL) {
+		indexes[i] = (int)(StationValue(node)->Name - stationNames);
+		int end = indexes[i] + (int)strlen(StationValue(node)->Name) + 1;
+		if (end > header.NamesSize)
+			header.NamesSize = end;
+		i++;
+	}
+	_SnapshotWrite(out, keys, sizeof(AVLKey), header.StationCount, &checksum);
+	_SnapshotWrite(out, values, sizeof(STATION), header.StationCount, &checksum);
+	_SnapshotWrite(out, indexes, sizeof(int), header.StationCount, &checksum);
+	_SnapshotWrite(out, stationNames, 1, header.NamesSize, &checksum);
+
+	// trip columns, as is
+	_SnapshotWrite(out, trips->TripID, sizeof(AVLKey), header.TripCount, &checksum);
+	_SnapshotWrite(out, trips->BikeID, sizeof(int), header.TripCount, &checksum);
+	_SnapshotWrite(out, trips->FromID, sizeof(int), header.TripCount, &checksum);
+	_SnapshotWrite(out, trips->ToID, sizeof(int), header.TripCount, &checksum);
+	_SnapshotWrite(out, trips->Duration, sizeof(int), header.TripCount, &checksum);
+	_SnapshotWrite(out, trips->StartTime, sizeof(long long), header.TripCount, &checksum);
+	_SnapshotWrite(out, trips->StopTime, sizeof(long long), header.TripCount, &checksum);
+
+	// bikes
+	memset(values, 0, valuesSize);
+	_SnapshotCollect(&bikes->Base, keys, values);
+	_SnapshotWrite(out, keys, sizeof(AVLKey), header.BikeCount, &checksum);
+	_SnapshotWrite(out, values, sizeof(BIKE), header.BikeCount, &checksum);
+
+	// route matrix, as is
+	_SnapshotWrite(out, routes->cells, sizeof(RouteCount), header.RouteSize, &checksum);
+
+	// trip indexes, already rows of the table
+	_SnapshotWrite(out, bikeTrips->Rows, sizeof(int), header.TripCount, &checksum);
+	_SnapshotWrite(out, tripsByTime->Rows, sizeof(int), header.TripCount, &checksum);
+
+	free(keys);
+	free(values);
+	free(indexes);
+
+	// now the real header
+	header.Checksum = checksum;
+	fseek(out, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, out);
+
+	int ok = (ferror(out) == 0);
+	ok = (fclose(out) == 0) && ok;
+
+	// replace the old snapshot
+	if (ok) {
+		remove(snapshotFileName);
+		ok = (rename(tempName, snapshotFileName) == 0);
+	}
+	if (!ok)
+		remove(tempName);
+
+	free(tempName);
+	return ok;
+}
+
+
+//
+// returns TRUE if all count indexes are in [0, limit)
+//
+static int _SnapshotIndexesOK(const int *indexes, int count, int limit) {
+
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (indexes[i] < 0 || indexes[i] >= limit)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+//
+// SnapshotLoad:
+//
+// Builds the trees, trip table, route matrix and trip indexes from the
+// snapshot, if there is a valid one for the CSV files; the trees and
+// the table must be empty.
+// Returns TRUE if successful, FALSE if the CSV files have to be loaded
+// instead, in which case nothing was changed.
+//
+int SnapshotLoad(char *snapshotFileName, char *StationsFileName, char *TripsFileName,
+	StationTree *stations, TripTable *trips, BikeTree *bikes, RouteMatrix *routes,
+	TripList *bikeTrips, TripList *tripsByTime, char **stationNames) {
+
+	MappedFile file;
+	SnapshotHeader header;
+	FileStamp stamp;
+	double start = TimerNow();
+	int i;
+
+	if (!MapFile(&file, snapshotFileName))
+		return FALSE;		// no snapshot yet
+
+	if (file.Size < sizeof(header)) {
+		UnmapFile(&file);
+		return FALSE;
+	}
+	memcpy(&header, file.Data, sizeof(header));
+
+	// made by this version of the program?
+	int ok = memcmp(header.Magic, SNAPSHOT_MAGIC, 8) == 0
+		&& header.Version == SNAPSHOT_VERSION
+		&& header.StationSize == sizeof(STATION)
+		&& header.BikeSize == sizeof(BIKE)
+		&& header.RouteCellSize == sizeof(RouteCount)
+		&& header.StationCount >= 0 && header.TripCount >= 0 && header.BikeCount >= 0
+		&& header.NamesSize >= 0 && header.RouteSize > 0
+		&& (header.RouteSize & (header.RouteSize - 1)) == 0;
+
+	// from the same CSV files?
+	ok = ok && _SnapshotStamp(StationsFileName, &stamp)
+		&& stamp.Size == header.Stations.Size && stamp.ModifiedTime == header.Stations.ModifiedTime;
+	ok = ok && _SnapshotStamp(TripsFileName, &stamp)
+		&& stamp.Size == header.Trips.Size && stamp.ModifiedTime == header.Trips.ModifiedTime;
+
+	// all there?
+	size_t offsets[17];
+	offsets[0] = sizeof(header);
+	offsets[1] = offsets[0] + _SnapshotPadded(sizeof(AVLKey), header.StationCount);
+	offsets[2] = offsets[1] + _SnapshotPadded(sizeof(STATION), header.StationCount);
+	offsets[3] = offsets[2] + _SnapshotPadded(sizeof(int), header.StationCount);
+	offsets[4] = offsets[3] + _SnapshotPadded(1, header.NamesSize);
+	offsets[5] = offsets[4] + _SnapshotPadded(sizeof(AVLKey), header.TripCount);
+	offsets[6] = offsets[5] + _SnapshotPadded(sizeof(int), header.TripCount);
+	offsets[7] = offsets[6] + _SnapshotPadded(sizeof(int), header.TripCount);
+	offsets[8] = offsets[7] + _SnapshotPadded(sizeof(int), header.TripCount);
+	offsets[9] = offsets[8] + _SnapshotPadded(sizeof(int), header.TripCount);
+	offsets[10] = offsets[9] + _SnapshotPadded(sizeof(long long), header.TripCount);
+	offsets[11] = offsets[10] + _SnapshotPadded(sizeof(long long), header.TripCount);
+	offsets[12] = offsets[11] + _SnapshotPadded(sizeof(AVLKey), header.BikeCount);
+	offsets[13] = offsets[12] + _SnapshotPadded(sizeof(BIKE), header.BikeCount);
+	offsets[14] = offsets[13] + _SnapshotPadded(sizeof(RouteCount), header.RouteSize);
+	offsets[15] = offsets[14] + _SnapshotPadded(sizeof(int), header.TripCount);
+	offsets[16] = offsets[15] + _SnapshotPadded(sizeof(int), header.TripCount);
+	ok = ok && offsets[16] == file.Size;
+
+	// and not damaged?
+	ok = ok && _SnapshotChecksum(SNAPSHOT_SEED, file.Data + sizeof(header),
+		file.Size - sizeof(header)) == header.Checksum;
+
+	const AVLKey *stationIDs = (const AVLKey*)(file.Data + offsets[0]);
+	const char *stationValues = file.Data + offsets[1];
+	const int *nameOffsets = (const int*)(file.Data + offsets[2]);
+	const char *names = file.Data + offsets[3];
+	const AVLKey *bikeIDs = (const AVLKey*)(file.Data + offsets[11]);
+	const char *bikeValues = file.Data + offsets[12];
+	const RouteCount *cells = (const RouteCount*)(file.Data + offsets[13]);
+	const int *bikeTripIndexes = (const int*)(file.Data + offsets[14]);
+	const int *timeIndexes = (const int*)(file.Data + offsets[15]);
+
+	ok = ok && _SnapshotIndexesOK(nameOffsets, header.StationCount, header.NamesSize)
+		&& _SnapshotIndexesOK(bikeTripIndexes, header.TripCount, header.TripCount)
+		&& _SnapshotIndexesOK(timeIndexes, header.TripCount, header.TripCount);
+
+	if (!ok) {
+		UnmapFile(&file);
+		return FALSE;
+	}
+
+	// stations, pointing to their names
+	*stationNames = (char*)malloc(header.NamesSize + 1);
+	memcpy(*stationNames, names, header.NamesSize);
+	(*stationNames)[header.NamesSize] = '\0';
+
+	AVLPair *pairs = _SnapshotPairs(stationIDs, stationValues, sizeof(STATION), header.StationCount);
+	AVLBuildFromSorted(&stations->Base, pairs, header.StationCount);
+	free(pairs);
+
+	AVLIterator iter;
+	AVLNode *node;
+	i = 0;
+	AVLIteratorInit(&iter, stations->Base.Root, AVLInOrder);
+	while ((node = AVLInOrderNext(&iter)) != NULL)
+		StationValue(node)->Name = *stationNames + nameOffsets[i++];
+
+	// trip columns, then the index over the ids
+	TripTableAllocate(trips, header.TripCount);
+	memcpy(trips->TripID, file.Data + offsets[4], sizeof(AVLKey) * header.TripCount);
+	memcpy(trips->BikeID, file.Data + offsets[5], sizeof(int) * header.TripCount);
+	memcpy(trips->FromID, file.Data + offsets[6], sizeof(int) * header.TripCount);
+	memcpy(trips->ToID, file.Data + offsets[7], sizeof(int) * header.TripCount);
+	memcpy(trips->Duration, file.Data + offsets[8], sizeof(int) * header.TripCount);
+	memcpy(trips->StartTime, file.Data + offsets[9], sizeof(long long) * header.TripCount);
+	memcpy(trips->StopTime, file.Data + offsets[10], sizeof(long long) * header.TripCount);
+	TripTableBuildIndex(trips);
+
+	// bikes
+	pairs = _SnapshotPairs(bikeIDs, bikeValues, sizeof(BIKE), header.BikeCount);
+	AVLBuildFromSorted(&bikes->Base, pairs, header.BikeCount);
+	free(pairs);
+
+	// route matrix
+	free(routes->cells);
+	routes->size = header.RouteSize;
+	routes->count = header.RouteCount;
+	routes->cells = (RouteCount*)malloc(sizeof(RouteCount) * routes->size);
+	memcpy(routes->cells, cells, sizeof(RouteCount) * routes->size);
+
+	// trip indexes
+	bikeTrips->Count = header.TripCount;
+	bikeTrips->Rows = (int*)malloc(sizeof(int) * (header.TripCount + 1));
+	memcpy(bikeTrips->Rows, bikeTripIndexes, sizeof(int) * header.TripCount);
+	tripsByTime->Count = header.TripCount;
+	tripsByTime->Rows = (int*)malloc(sizeof(int) * (header.TripCount + 1));
+	memcpy(tripsByTime->Rows, timeIndexes, sizeof(int) * header.TripCount);
+
+	UnmapFile(&file);
+
+	PERF_STOP(PerfLoadSnapshot, start);
+	double seconds = TimerNow() - start;
+	fprintf(stderr, "** Loaded snapshot '%s': %d stations, %d trips, %d bikes in %.3f secs "
+		"(CSV load took %.3f secs, %.1fx faster)\n", snapshotFileName, header.StationCount,
+		header.TripCount, header.BikeCount, seconds, header.CSVLoadSeconds,
+		header.CSVLoadSeconds / (seconds > 0 ? seconds : 1e-9));
+
+	return TRUE;
+}
@@ -0,0 +1,83 @@
+/*snapshot.h*/
+
+//
+// Binary snapshot of the loaded trees, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "avl.h"
+#include "routes.h"
+#include "triptable.h"
+
+#define SNAPSHOT_MAGIC		"DIVVYSNP"
+#define SNAPSHOT_VERSION	3
+#define SNAPSHOT_SUFFIX		".snap"		// snapshot of x.csv is x.csv.snap
+
+
+//
+// snapshot type declarations:
+//
+
+// size and last modification time of a source file
+typedef struct FileStamp
+{
+	long long	Size;
+	long long	ModifiedTime;
+
+} FileStamp;
+
+// start of the file, followed by the sections in this order, each
+// padded to 8 bytes:
+//   AVLKey   stationIDs[StationCount]  (ascending)
+//   STATION  stations[StationCount]    (Name is not valid)
+//   int      nameOffsets[StationCount]
+//   char     names[NamesSize]
+//   AVLKey   tripIDs[TripCount]        (ascending)
+//   int      bikeIDs[TripCount]        (then one section per trip
+//   int      fromIDs[TripCount]         table column, row i of each
+//   int      toIDs[TripCount]           is the i-th trip)
+//   int      durations[TripCount]
+//   long long startTimes[TripCount]
+//   long long stopTimes[TripCount]
+//   AVLKey   bikeIDs[BikeCount]        (ascending)
+//   BIKE     bikes[BikeCount]
+//   RouteCount cells[RouteSize]
+//   int      bikeTrips[TripCount]      (row in the trip table)
+//   int      tripsByTime[TripCount]    (row in the trip table)
+typedef struct SnapshotHeader
+{
+	char		Magic[8];
+	int			Version;
+	int			StationSize;	// sizeof(STATION) of the writer
+	int			RouteCellSize;	// sizeof(RouteCount) of the writer
+	int			StationCount;
+	int			TripCount;
+	int			BikeCount;
+	int			RouteSize;		// # of cells, including empty ones
+	int			RouteCount;		// # of non-empty cells
+	int			NamesSize;
+	int			BikeSize;		// sizeof(BIKE) of the writer
+	FileStamp	Stations;		// the CSV files it was made from
+	FileStamp	Trips;
+	double		CSVLoadSeconds;	// how long loading those took
+	unsigned long long Checksum;	// of everything after the header
+
+} SnapshotHeader;
+
+
+//
+// snapshot API:
+// function prototypes
+//
+int SnapshotLoad(char *snapshotFileName, char *StationsFileName, char *TripsFileName,
+	StationTree *stations, TripTable *trips, BikeTree *bikes, RouteMatrix *routes,
+	TripList *bikeTrips, TripList *tripsByTime, char **stationNames);
+int SnapshotSave(char *snapshotFileName, char *StationsFileName, char *TripsFileName,
+	StationTree *stations, TripTable *trips, BikeTree *bikes, RouteMatrix *routes,
+	TripList *bikeTrips, TripList *tripsByTime, char *stationNames, double csvLoadSeconds);
@@ -0,0 +1,102 @@
+/*thread.c*/
+
+//
+// Minimal portable threads, implementation file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+#ifndef _WIN32
+#define _GNU_SOURCE
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "thread.h"
+#include "perf.h"
+
+
+//
+// calls the thread function with its argument, then lets go of the
+// thread's perf block, see PerfThreadEnd
+//
+#ifdef _WIN32
+static DWORD WINAPI _ThreadMain(LPVOID param) {
+
+	Thread *thread = (Thread*)param;
+
+	thread->Function(thread->Arg);
+	PerfThreadEnd();		// its perf block goes back to the pool
+	return 0;
+}
+#else
+static void *_ThreadMain(void *param) {
+
+	Thread *thread = (Thread*)param;
+
+	thread->Function(thread->Arg);
+	PerfThreadEnd();		// its perf block goes back to the pool
+	return NULL;
+}
+#endif
+
+
+//
+// ThreadStart:
+//
+// Starts function(arg) on a new thread.  The Thread struct must stay
+// alive until ThreadJoin.  Returns TRUE (non-zero) if successful,
+// FALSE (0) if not.
+//
+int ThreadStart(Thread *thread, void(*function)(void *arg), void *arg) {
+
+	thread->Function = function;
+	thread->Arg = arg;
+
+#ifdef _WIN32
+	thread->Handle = CreateThread(NULL, 0, _ThreadMain, thread, 0, NULL);
+	return thread->Handle != NULL;
+#else
+	return pthread_create(&thread->Handle, NULL, _ThreadMain, thread) == 0;
+#endif
+}
+
+
+//
+// ThreadJoin:
+//
+// Waits for the thread to finish.
+//
+void ThreadJoin(Thread *thread) {
+
+#ifdef _WIN32
+	WaitForSingleObject(thread->Handle, INFINITE);
+	CloseHandle(thread->Handle);
+#else
+	pthread_join(thread->Handle, NULL);
+#endif
+}
+
+
+//
+// ThreadHardwareCount:
+//
+// Returns # of hardware threads of the machine.
+//
+int ThreadHardwareCount() {
+
+#ifdef _WIN32
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return (count > 0) ? (int)count : 1;
+#endif
+}
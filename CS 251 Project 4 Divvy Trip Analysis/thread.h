@@ -0,0 +1,43 @@
+/*thread.h*/
+
+//
+// Minimal portable threads, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+
+//
+// thread type declarations:
+//
+typedef struct Thread
+{
+#ifdef _WIN32
+	HANDLE		Handle;
+#else
+	pthread_t	Handle;
+#endif
+	void		(*Function)(void *arg);
+	void		*Arg;
+
+} Thread;
+
+
+//
+// thread API:
+// function prototypes
+//
+int ThreadStart(Thread *thread, void(*function)(void *arg), void *arg);
+void ThreadJoin(Thread *thread);
+int ThreadHardwareCount();
@@ -0,0 +1,46 @@
+/*timer.c*/
+
+//
+// Monotonic clock, implementation file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "timer.h"
+
+
+//
+// TimerNow:
+//
+// Returns the current time of a monotonic clock, in seconds.  Only
+// differences between two calls are meaningful.
+//
+double TimerNow() {
+
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+#endif
+}
@@ -0,0 +1,19 @@
+/*timer.h*/
+
+//
+// Monotonic clock, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+
+//
+// timer API:
+// function prototypes
+//
+double TimerNow();
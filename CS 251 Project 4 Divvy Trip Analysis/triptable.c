@@ -0,0 +1,311 @@
+/*triptable.c*/
+
+//
+// Columnar trip table, implementation file.
+//
+// The trips are kept one column per field, sorted by trip id, instead
+// of one AVLNode each: scans over every trip (counting routes, station
+// trips, ...) stream through just the columns they need, and the only
+// per-trip overhead is a 16-byte compact AVL node mapping the id to
+// its row.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// ignore stdlib warnings if working in Visual Studio:
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "triptable.h"
+
+
+//
+// TripTableCreate:
+//
+// Creates an empty table.
+//
+TripTable *TripTableCreate() {
+
+	TripTable *table = (TripTable*)malloc(sizeof(TripTable));
+
+	memset(table, 0, sizeof(TripTable));
+	table->Index = CAVLCreate();
+
+	return table;
+}
+
+
+//
+// TripTableAllocate:
+//
+// Makes room for count rows, the table must be empty; the caller fills
+// in the columns, in ascending trip id order, then calls
+// TripTableBuildIndex.
+//
+void TripTableAllocate(TripTable *table, int count) {
+
+	table->Count = count;
+	table->Size = count + 1;
+	table->TripID = (AVLKey*)malloc(sizeof(AVLKey) * table->Size);
+	table->BikeID = (int*)malloc(sizeof(int) * table->Size);
+	table->FromID = (int*)malloc(sizeof(int) * table->Size);
+	table->ToID = (int*)malloc(sizeof(int) * table->Size);
+	table->Duration = (int*)malloc(sizeof(int) * table->Size);
+	table->StartTime = (long long*)malloc(sizeof(long long) * table->Size);
+	table->StopTime = (long long*)malloc(sizeof(long long) * table->Size);
+}
+
+
+//
+// makes room for size rows in the columns, keeping the first Count
+//
+static void _TripTableGrow(TripTable *table, int size) {
+
+	table->Size = size;
+	table->TripID = (AVLKey*)realloc(table->TripID, sizeof(AVLKey) * size);
+	table->BikeID = (int*)realloc(table->BikeID, sizeof(int) * size);
+	table->FromID = (int*)realloc(table->FromID, sizeof(int) * size);
+	table->ToID = (int*)realloc(table->ToID, sizeof(int) * size);
+	table->Duration = (int*)realloc(table->Duration, sizeof(int) * size);
+	table->StartTime = (long long*)realloc(table->StartTime, sizeof(long long) * size);
+	table->StopTime = (long long*)realloc(table->StopTime, sizeof(long long) * size);
+}
+
+
+//
+// copies row from of the table, or the pair if table is NULL, into
+// row to of dest
+//
+static void _TripTableCopyRow(TripTable *dest, int to, TripTable *table, int from,
+	const AVLPair *pair) {
+
+	if (table != NULL) {
+		dest->TripID[to] = table->TripID[from];
+		dest->BikeID[to] = table->BikeID[from];
+		dest->FromID[to] = table->FromID[from];
+		dest->ToID[to] = table->ToID[from];
+		dest->Duration[to] = table->Duration[from];
+		dest->StartTime[to] = table->StartTime[from];
+		dest->StopTime[to] = table->StopTime[from];
+	}
+	else {
+		const TRIP *trip = (const TRIP*)pair->Value;
+
+		dest->TripID[to] = pair->Key;
+		dest->BikeID[to] = trip->BikeID;
+		dest->FromID[to] = trip->FromID;
+		dest->ToID[to] = trip->ToID;
+		dest->Duration[to] = trip->TripDuration.minutes * 60 + trip->TripDuration.seconds;
+		dest->StartTime[to] = trip->StartTime;
+		dest->StopTime[to] = trip->StopTime;
+	}
+}
+
+
+//
+// TripTableBuild:
+//
+// Fills the empty table from (trip id, TRIP) pairs sorted by key with
+// no duplicates, see AVLSortPairs, and builds the index.
+//
+void TripTableBuild(TripTable *table, const AVLPair *pairs, int count) {
+
+	int i;
+
+	TripTableAllocate(table, count);
+
+	for (i = 0; i < count; i++)
+		_TripTableCopyRow(table, i, NULL, 0, &pairs[i]);
+
+	TripTableBuildIndex(table);
+}
+
+
+//
+// TripTableBuildIndex:
+//
+// Builds the id => row index from the TripID column.
+//
+void TripTableBuildIndex(TripTable *table) {
+
+	CAVLBuildFromSorted(table->Index, table->TripID, table->Count);
+}
+
+
+//
+// TripTableInsert:
+//
+// Adds count trips, sorted by key with no duplicates and none of them
+// already in the table, and stores the row of each in rows.
+//
+// New trips usually have the largest ids yet: then the columns grow
+// (doubling, so appends are amortized O(1) per row), each id goes into
+// the index with CAVLInsert, whose node i is still row i, and *moved
+// is set to NULL.  Otherwise the old and new rows are merged into new
+// columns and the index is rebuilt, O(N), and *moved is set to a new
+// array of the new row of each old row, for the caller to renumber
+// its lists of rows with and free.
+//
+void TripTableInsert(TripTable *table, const AVLPair *pairs, int count, int *rows, int **moved) {
+
+	int oldCount = table->Count;
+	int i, j, row;
+
+	*moved = NULL;
+	if (count <= 0)
+		return;
+
+	// all after the last row, append
+	if (oldCount == 0 || pairs[0].Key > table->TripID[oldCount - 1]) {
+		if (oldCount + count >= table->Size)
+			_TripTableGrow(table, 2 * (oldCount + count));
+
+		for (i = 0; i < count; i++) {
+			row = oldCount + i;
+			_TripTableCopyRow(table, row, NULL, 0, &pairs[i]);
+			CAVLInsert(table->Index, pairs[i].Key);		// node row
+			rows[i] = row;
+		}
+
+		table->Count = oldCount + count;
+		return;
+	}
+
+	// else merge by id into new columns
+	TripTable *merged = TripTableCreate();
+	TripTableAllocate(merged, oldCount + count);
+	*moved = (int*)malloc(sizeof(int) * (oldCount + 1));
+
+	for (i = 0, j = 0, row = 0; i < oldCount || j < count; row++) {
+		if (j == count || (i < oldCount && table->TripID[i] < pairs[j].Key)) {
+			_TripTableCopyRow(merged, row, table, i, NULL);
+			(*moved)[i++] = row;
+		}
+		else {
+			_TripTableCopyRow(merged, row, NULL, 0, &pairs[j]);
+			rows[j++] = row;
+		}
+	}
+
+	TripTableBuildIndex(merged);
+
+	// swap the contents, free the old columns with the new handle
+	TripTable old = *table;
+	*table = *merged;
+	*merged = old;
+	TripTableFree(merged);
+}
+
+
+//
+// TripTableFind:
+//
+// Returns the row of the trip with the given id, -1 if not found.
+//
+int TripTableFind(TripTable *table, AVLKey id) {
+
+	return CAVLSearch(table->Index, id);
+}
+
+
+//
+// TripTableLowerBound:
+//
+// Returns the first row with trip id >= id, Count if there is none --
+// which is also # of trips with a smaller id.  Binary search.
+//
+int TripTableLowerBound(TripTable *table, AVLKey id) {
+
+	int lo = 0, hi = table->Count;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (table->TripID[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+//
+// TripTableGet:
+//
+// Returns the row as a TRIP record.
+//
+TRIP TripTableGet(TripTable *table, int row) {
+
+	TRIP trip;
+
+	trip.BikeID = table->BikeID[row];
+	trip.FromID = table->FromID[row];
+	trip.ToID = table->ToID[row];
+	trip.TripDuration = ConvertDuration(table->Duration[row]);
+	trip.StartTime = table->StartTime[row];
+	trip.StopTime = table->StopTime[row];
+
+	return trip;
+}
+
+
+//
+// TripTableCount:
+//
+// Returns # of trips in the table.
+//
+int TripTableCount(TripTable *table) {
+
+	return table->Count;
+}
+
+
+//
+// TripTableHeight:
+//
+// Returns the height of the index.
+//
+int TripTableHeight(TripTable *table) {
+
+	return CAVLHeight(table->Index);
+}
+
+
+//
+// TripTableBytes:
+//
+// Returns the memory used by the rows and the index, both by what is
+// in use -- one row and one index node per trip -- not by the room
+// allocated for them.
+//
+size_t TripTableBytes(TripTable *table) {
+
+	return (size_t)table->Count * TRIPTABLE_ROW_BYTES
+		+ (size_t)CAVLCount(table->Index) * sizeof(CAVLNode);
+}
+
+
+//
+// TripTableFree:
+//
+// Frees the table.
+//
+void TripTableFree(TripTable *table) {
+
+	CAVLFree(table->Index);
+	free(table->TripID);
+	free(table->BikeID);
+	free(table->FromID);
+	free(table->ToID);
+	free(table->Duration);
+	free(table->StartTime);
+	free(table->StopTime);
+	free(table);
+}
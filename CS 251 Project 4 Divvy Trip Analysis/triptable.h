@@ -0,0 +1,57 @@
+/*triptable.h*/
+
+//
+// Columnar trip table, header file.
+//
+// << Michal Bochnak >>
+// U. of Illinois, Chicago
+// CS251, Spring 2017
+//
+
+// make sure this header file is #include exactly once:
+#pragma once
+
+#include "avl.h"
+#include "cavl.h"
+
+
+//
+// trip table type declarations:
+//
+
+// one array per column, row i of every column is the i-th trip by id;
+// Index maps a trip id to its row (node i of the compact tree is row i)
+struct TripTable
+{
+	CAVL		*Index;
+	AVLKey		*TripID;		// ascending
+	int			*BikeID;
+	int			*FromID;
+	int			*ToID;
+	int			*Duration;		// seconds
+	long long	*StartTime;		// seconds since 1970-01-01 00:00, -1 => unknown
+	long long	*StopTime;
+	int			Count;
+	int			Size;			// room in the columns
+};
+
+// bytes per row in the columns, not counting the index
+#define TRIPTABLE_ROW_BYTES (4 * (int)sizeof(int) + 2 * (int)sizeof(long long) + (int)sizeof(AVLKey))
+
+
+//
+// trip table API:
+// function prototypes
+//
+TripTable *TripTableCreate();
+void TripTableAllocate(TripTable *table, int count);
+void TripTableBuild(TripTable *table, const AVLPair *pairs, int count);
+void TripTableBuildIndex(TripTable *table);
+void TripTableInsert(TripTable *table, const AVLPair *pairs, int count, int *rows, int **moved);
+int TripTableFind(TripTable *table, AVLKey id);
+int TripTableLowerBound(TripTable *table, AVLKey id);
+TRIP TripTableGet(TripTable *table, int row);
+int TripTableCount(TripTable *table);
+int TripTableHeight(TripTable *table);
+size_t TripTableBytes(TripTable *table);
+void TripTableFree(TripTable *table);